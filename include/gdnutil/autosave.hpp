@@ -0,0 +1,290 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <Dictionary.hpp>
+#include <JSON.hpp>
+#include <String.hpp>
+#include "binary_codec.hpp"
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace gdn {
+
+enum class AutoSaveFormat
+{
+	json,
+	binary,
+};
+
+// Writes documents to disk on a background thread so that autosaving
+// never stalls the main thread:
+//
+//   gdn::AutoSave autosave { project_dir / "autosave.json" };
+//
+//   // every few seconds, if anything changed
+//   autosave.save(encode_project(model));
+//
+// save() only hands over a reference to the document, so it costs the
+// same whatever the document's size; serializing and writing happen on
+// the worker. If a write is still running, the document waits for it,
+// replacing any other document that was waiting, so a slow disk costs
+// intermediate saves rather than memory or main thread time.
+//
+// Godot 3 shares Dictionaries and Arrays rather than copying them on
+// write, so a document must not be modified once it's been passed to
+// save(). Build a new one for each save; an EncodeCache makes that cheap
+// by only rebuilding what changed, and the subtrees it reuses are never
+// modified.
+//
+// Each write goes to a temporary file next to the target, which is
+// flushed to disk and then replaces the target in one rename, so a crash
+// mid-write leaves the previous save intact. Errors are kept for
+// take_error() rather than thrown on the main thread.
+//
+// The JSON singleton is fetched by the constructor, on the main thread;
+// the worker only calls JSON::print(), which reads the document and
+// touches no shared state.
+class AutoSave
+{
+public:
+
+	AutoSave(std::filesystem::path path, AutoSaveFormat format = AutoSaveFormat::json);
+	AutoSave(const AutoSave&) = delete;
+	auto operator=(const AutoSave&) -> AutoSave& = delete;
+
+	// Finishes the pending write, if any
+	~AutoSave();
+
+	auto save(godot::Dictionary document) -> void;
+
+	// Blocks until everything passed to save() so far has been written
+	auto wait() -> void;
+
+	auto is_busy() const -> bool;
+	auto get_write_count() const -> size_t;
+	auto take_error() -> std::optional<std::string>;
+
+private:
+
+	auto run() -> void;
+	auto write(const godot::Dictionary& document) const -> void;
+
+	const std::filesystem::path path_;
+	const AutoSaveFormat format_;
+	godot::JSON* const json_;
+	mutable std::mutex mutex_;
+	std::condition_variable work_;
+	std::condition_variable idle_;
+	std::optional<godot::Dictionary> pending_;
+	std::optional<std::string> error_;
+	size_t write_count_{0};
+	bool writing_{false};
+	bool stop_{false};
+	std::thread thread_;
+};
+
+namespace detail {
+
+// Writes data beside path, flushes it to disk and renames it over path
+inline auto replace_file(const std::filesystem::path& path, const uint8_t* data, size_t size) -> void
+{
+	auto temp { path };
+
+	temp += ".tmp";
+
+	{
+		std::ofstream file { temp, std::ios::binary | std::ios::trunc };
+
+		file.write(reinterpret_cast<const char*>(data), std::streamsize(size));
+		file.close();
+
+		if (!file)
+		{
+			throw std::runtime_error("Couldn't write file: " + temp.string());
+		}
+	}
+
+	// Otherwise the rename can reach the disk before the data does
+#if defined(_WIN32)
+	if (const auto handle { CreateFileW(temp.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr) }; handle != INVALID_HANDLE_VALUE)
+	{
+		FlushFileBuffers(handle);
+		CloseHandle(handle);
+	}
+
+	if (!MoveFileExW(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+	{
+		throw std::runtime_error("Couldn't replace file: " + path.string() + ": error " + std::to_string(GetLastError()));
+	}
+#else
+	if (const auto fd { ::open(temp.c_str(), O_RDONLY) }; fd >= 0)
+	{
+		::fsync(fd);
+		::close(fd);
+	}
+
+	std::error_code error;
+
+	std::filesystem::rename(temp, path, error);
+
+	if (error)
+	{
+		throw std::runtime_error("Couldn't replace file: " + path.string() + ": " + error.message());
+	}
+#endif
+}
+
+} // detail
+
+// +++ AutoSave ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+inline AutoSave::AutoSave(std::filesystem::path path, AutoSaveFormat format)
+	: path_{std::move(path)}
+	, format_{format}
+	, json_{godot::JSON::get_singleton()}
+	, thread_{[this] { run(); }}
+{
+}
+
+inline AutoSave::~AutoSave()
+{
+	{
+		std::lock_guard lock{mutex_};
+		stop_ = true;
+	}
+
+	work_.notify_one();
+	thread_.join();
+}
+
+inline auto AutoSave::save(godot::Dictionary document) -> void
+{
+	std::optional<godot::Dictionary> replaced;
+
+	{
+		std::lock_guard lock{mutex_};
+
+		// Released outside the lock in case this was its last reference
+		replaced = std::move(pending_);
+		pending_ = std::move(document);
+	}
+
+	work_.notify_one();
+}
+
+inline auto AutoSave::wait() -> void
+{
+	std::unique_lock lock{mutex_};
+
+	idle_.wait(lock, [this] { return !pending_ && !writing_; });
+}
+
+inline auto AutoSave::is_busy() const -> bool
+{
+	std::lock_guard lock{mutex_};
+
+	return pending_ || writing_;
+}
+
+inline auto AutoSave::get_write_count() const -> size_t
+{
+	std::lock_guard lock{mutex_};
+
+	return write_count_;
+}
+
+inline auto AutoSave::take_error() -> std::optional<std::string>
+{
+	std::lock_guard lock{mutex_};
+
+	return std::exchange(error_, std::nullopt);
+}
+
+inline auto AutoSave::run() -> void
+{
+	for (;;)
+	{
+		std::optional<godot::Dictionary> document;
+
+		{
+			std::unique_lock lock{mutex_};
+
+			work_.wait(lock, [this] { return stop_ || pending_; });
+
+			// A document still waiting is written before stopping
+			if (!pending_) return;
+
+			document = std::move(pending_);
+			pending_.reset();
+			writing_ = true;
+		}
+
+		std::optional<std::string> error;
+
+		try
+		{
+			write(*document);
+		}
+		catch (const std::exception& e)
+		{
+			error = e.what();
+		}
+
+		document.reset();
+
+		{
+			std::lock_guard lock{mutex_};
+
+			writing_ = false;
+
+			if (error) error_ = std::move(error);
+			else write_count_++;
+		}
+
+		idle_.notify_all();
+	}
+}
+
+inline auto AutoSave::write(const godot::Dictionary& document) const -> void
+{
+	switch (format_)
+	{
+		case AutoSaveFormat::binary:
+		{
+			const auto data { binary::encode(document) };
+
+			detail::replace_file(path_, data.data(), data.size());
+			return;
+		}
+		case AutoSaveFormat::json:
+		{
+			const auto text { to_std_string(json_->print(document)) };
+
+			detail::replace_file(path_, reinterpret_cast<const uint8_t*>(text.data()), text.size());
+			return;
+		}
+	}
+}
+
+} // gdn
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <Dictionary.hpp>
+#include <InputEventKey.hpp>
+#include <String.hpp>
+#include "dictionary_helpers.hpp"
+#include "input_handler.hpp"
+
+namespace gdn {
+namespace benchmarks {
+
+// Micro benchmarks for the hot paths in this library. They need a running
+// engine, so call them from a tool script or a debug menu, e.g.
+//
+//   godot::Godot::print(godot::JSON::get_singleton()->print(gdn::benchmarks::dictionary_iteration()));
+//
+// Each returns a Dictionary with the best of repeats runs of every variant,
+// in microseconds.
+
+namespace detail {
+
+template <typename Fn>
+auto best_usecs(int repeats, Fn&& fn) -> int64_t
+{
+	using clock = std::chrono::steady_clock;
+
+	auto best { std::numeric_limits<int64_t>::max() };
+
+	for (int i = 0; i < std::max(repeats, 1); i++)
+	{
+		const auto start { clock::now() };
+
+		fn();
+
+		best = std::min(best, int64_t(std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start).count()));
+	}
+
+	return best;
+}
+
+} // detail
+
+// keys() plus d[key] per item, as visit_dictionary_items used to, against
+// for_each_item()
+inline auto dictionary_iteration(int64_t entries = 100000, int repeats = 5) -> godot::Dictionary
+{
+	godot::Dictionary d;
+
+	for (int64_t i = 0; i < entries; i++)
+	{
+		d[godot::String::num_int64(i)] = i;
+	}
+
+	int64_t sum { 0 };
+
+	godot::Dictionary out;
+
+	out["entries"] = entries;
+	out["keys"] = detail::best_usecs(repeats, [&]
+	{
+		const auto keys { d.keys() };
+
+		for (int i = 0; i < keys.size(); i++)
+		{
+			sum += int64_t(d[keys[i]]);
+		}
+	});
+
+	out["for_each_item"] = detail::best_usecs(repeats, [&]
+	{
+		for_each_item(d, [&sum](const godot::Variant&, const godot::Variant& value)
+		{
+			sum += int64_t(value);
+		});
+	});
+
+	// Keeps the loops from being optimized away
+	out["sum"] = sum;
+
+	return out;
+}
+
+// A key event dispatched through InputHandler, against the same event
+// cast and handed to a std::function taking the Ref by value, as
+// InputHandler did before its callbacks became InlineFunctions. The
+// latter times only that last hop, not the rest of InputHandler's dispatch
+inline auto input_dispatch(int64_t events = 1000000, int repeats = 5) -> godot::Dictionary
+{
+	const godot::Ref<godot::InputEvent> event { godot::InputEventKey::_new() };
+
+	int64_t calls { 0 };
+
+	InputHandler handler;
+
+	handler.config.key.on_event = [&calls](const godot::Ref<godot::InputEventKey>&) { calls++; };
+
+	const std::function<void(godot::Ref<godot::InputEventKey>)> by_value { [&calls](godot::Ref<godot::InputEventKey>) { calls++; } };
+
+	godot::Dictionary out;
+
+	out["events"] = events;
+	out["input_handler"] = detail::best_usecs(repeats, [&]
+	{
+		for (int64_t i = 0; i < events; i++)
+		{
+			handler(event);
+		}
+	});
+
+	out["std_function"] = detail::best_usecs(repeats, [&]
+	{
+		for (int64_t i = 0; i < events; i++)
+		{
+			godot::Ref<godot::InputEventKey> key = event;
+
+			if (key.is_valid()) by_value(key);
+		}
+	});
+
+	out["calls"] = calls;
+
+	return out;
+}
+
+} // benchmarks
+} // gdn
@@ -0,0 +1,871 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <Array.hpp>
+#include <Color.hpp>
+#include <Dictionary.hpp>
+#include <JSON.hpp>
+#include <JSONParseResult.hpp>
+#include <String.hpp>
+#include <Transform2D.hpp>
+#include "dictionary_helpers.hpp"
+#include "string_helpers.hpp"
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace gdn {
+namespace binary {
+
+// Compact binary form of the Variant trees produced by encode(), for
+// documents too big to save as JSON. Covers the types dictionary_helpers.hpp
+// deals with: nil, bool, int, float, String, Color, Transform2D, Array,
+// Dictionary and the byte, int, real and color pool arrays. Anything else
+// throws.
+//
+// File layout: "GDNB", u32 format version, then the root value. Each value
+// is a u8 tag followed by:
+//
+//   bool         u8
+//   int          i64
+//   float        f64
+//   String       u32 size, utf8 bytes, a terminating zero
+//   Color        4 x f32
+//   Transform2D  6 x f32
+//   Array        u32 section size, u32 count, values
+//   Dictionary   u32 section size, u32 count, key/value pairs
+//   Pool*Array   u32 count, the elements copied as is (u8, i32, f32 or
+//                4 x f32 for PoolByte/Int/Real/ColorArray)
+//
+// Everything is little endian and unaligned. Section sizes count the bytes
+// after the size field itself, so a reader can hop over a whole subtree.
+// Strings are zero terminated so they can be handed to godot::String
+// straight out of a mapped file.
+//
+// Value gives typed, allocation-free access to an encoded buffer (such as
+// a MappedFile), decode() rebuilds the Variant tree, and from_json() /
+// to_json() convert between this format and JSON text.
+
+static_assert (std::endian::native == std::endian::little);
+
+enum class Tag : uint8_t
+{
+	nil,
+	boolean,
+	integer,
+	real,
+	string,
+	color,
+	transform2d,
+	array,
+	dictionary,
+	pool_byte_array,
+	pool_int_array,
+	pool_real_array,
+	pool_color_array,
+};
+
+template <typename T> struct get_pool_tag{};
+template <> struct get_pool_tag<uint8_t>{ static constexpr auto value { Tag::pool_byte_array }; };
+template <> struct get_pool_tag<int32_t>{ static constexpr auto value { Tag::pool_int_array }; };
+template <> struct get_pool_tag<float>{ static constexpr auto value { Tag::pool_real_array }; };
+template <> struct get_pool_tag<godot::Color>{ static constexpr auto value { Tag::pool_color_array }; };
+
+static constexpr char MAGIC[4] { 'G', 'D', 'N', 'B' };
+static constexpr uint32_t FORMAT_VERSION { 1 };
+static constexpr size_t HEADER_SIZE { 8 };
+
+namespace detail {
+
+inline auto corrupt() -> void
+{
+	throw std::runtime_error("Corrupt binary document");
+}
+
+template <typename T>
+auto put(const T& value, std::vector<uint8_t>* out) -> void
+{
+	const auto at { out->size() };
+
+	out->resize(at + sizeof(T));
+	std::memcpy(out->data() + at, &value, sizeof(T));
+}
+
+template <typename T>
+auto peek(const uint8_t* at, const uint8_t* end) -> T
+{
+	T out;
+
+	if (size_t(end - at) < sizeof(T)) corrupt();
+
+	std::memcpy(&out, at, sizeof(T));
+
+	return out;
+}
+
+// Size of the section starting at at (the value after the tag)
+inline auto payload_size(Tag tag, const uint8_t* at, const uint8_t* end) -> size_t
+{
+	switch (tag)
+	{
+		case Tag::nil: return 0;
+		case Tag::boolean: return 1;
+		case Tag::integer: return 8;
+		case Tag::real: return 8;
+		case Tag::string: return 4 + size_t(peek<uint32_t>(at, end)) + 1;
+		case Tag::color: return 16;
+		case Tag::transform2d: return 24;
+		case Tag::array:
+		case Tag::dictionary: return 4 + size_t(peek<uint32_t>(at, end));
+		case Tag::pool_byte_array: return 4 + size_t(peek<uint32_t>(at, end));
+		case Tag::pool_int_array: return 4 + size_t(peek<uint32_t>(at, end)) * 4;
+		case Tag::pool_real_array: return 4 + size_t(peek<uint32_t>(at, end)) * 4;
+		case Tag::pool_color_array: return 4 + size_t(peek<uint32_t>(at, end)) * 16;
+	}
+
+	corrupt();
+	return 0;
+}
+
+inline auto write(const godot::Variant& value, std::vector<uint8_t>* out) -> void;
+
+template <pool_element T>
+auto write_pool_array(typename get_pool_array<T>::type data, std::vector<uint8_t>* out) -> void
+{
+	static_assert (sizeof(T) == 1 || sizeof(T) == 4 || sizeof(T) == 16);
+
+	const auto count { uint32_t(data.size()) };
+
+	put(get_pool_tag<T>::value, out);
+	put(count, out);
+
+	if (count == 0) return;
+
+	const auto at { out->size() };
+	const auto read { data.read() };
+
+	out->resize(at + count * sizeof(T));
+	std::memcpy(out->data() + at, read.ptr(), count * sizeof(T));
+}
+
+inline auto write_section(Tag tag, uint32_t count, std::vector<uint8_t>* out) -> size_t
+{
+	put(tag, out);
+
+	const auto at { out->size() };
+
+	put(uint32_t{}, out); // section size, filled in by end_section
+	put(count, out);
+
+	return at;
+}
+
+inline auto end_section(size_t at, std::vector<uint8_t>* out) -> void
+{
+	const auto size { out->size() - at - 4 };
+
+	if (size > UINT32_MAX)
+	{
+		throw std::runtime_error("Binary document section too large");
+	}
+
+	const auto size32 { uint32_t(size) };
+
+	std::memcpy(out->data() + at, &size32, sizeof(size32));
+}
+
+inline auto write(const godot::Variant& value, std::vector<uint8_t>* out) -> void
+{
+	switch (value.get_type())
+	{
+		case godot::Variant::NIL:
+		{
+			put(Tag::nil, out);
+			return;
+		}
+		case godot::Variant::BOOL:
+		{
+			put(Tag::boolean, out);
+			put(uint8_t(bool(value)), out);
+			return;
+		}
+		case godot::Variant::INT:
+		{
+			put(Tag::integer, out);
+			put(int64_t(value), out);
+			return;
+		}
+		case godot::Variant::REAL:
+		{
+			put(Tag::real, out);
+			put(double(value), out);
+			return;
+		}
+		case godot::Variant::STRING:
+		{
+			const auto utf8 { godot::String(value).utf8() };
+			const auto size { uint32_t(utf8.length()) };
+			const auto at { out->size() };
+
+			put(Tag::string, out);
+			put(size, out);
+			out->resize(at + 1 + 4 + size + 1);
+			std::memcpy(out->data() + at + 1 + 4, utf8.get_data(), size);
+			return;
+		}
+		case godot::Variant::COLOR:
+		{
+			const auto color { godot::Color(value) };
+
+			put(Tag::color, out);
+			put(float(color.r), out);
+			put(float(color.g), out);
+			put(float(color.b), out);
+			put(float(color.a), out);
+			return;
+		}
+		case godot::Variant::TRANSFORM2D:
+		{
+			const auto xform { godot::Transform2D(value) };
+
+			put(Tag::transform2d, out);
+
+			for (int i = 0; i < 3; i++)
+			{
+				put(float(xform[i][0]), out);
+				put(float(xform[i][1]), out);
+			}
+
+			return;
+		}
+		case godot::Variant::ARRAY:
+		{
+			const godot::Array array { value };
+			const auto at { write_section(Tag::array, uint32_t(array.size()), out) };
+
+			for (int i = 0; i < array.size(); i++)
+			{
+				write(array[i], out);
+			}
+
+			end_section(at, out);
+			return;
+		}
+		case godot::Variant::DICTIONARY:
+		{
+			const godot::Dictionary dictionary { value };
+			const auto at { write_section(Tag::dictionary, uint32_t(dictionary.size()), out) };
+
+			for_each_item(dictionary, [out](const godot::Variant& key, const godot::Variant& item)
+			{
+				write(key, out);
+				write(item, out);
+			});
+
+			end_section(at, out);
+			return;
+		}
+		case godot::Variant::POOL_BYTE_ARRAY: write_pool_array<uint8_t>(value, out); return;
+		case godot::Variant::POOL_INT_ARRAY: write_pool_array<int32_t>(value, out); return;
+		case godot::Variant::POOL_REAL_ARRAY: write_pool_array<float>(value, out); return;
+		case godot::Variant::POOL_COLOR_ARRAY: write_pool_array<godot::Color>(value, out); return;
+		default:
+		{
+			throw std::runtime_error("Unsupported type in binary document");
+		}
+	}
+}
+
+// JSON.print writes byte and color pool arrays as strings, which don't
+// read back, so they're replaced with Arrays the way encode() writes them
+inline auto make_json_safe(godot::Variant* value) -> void
+{
+	switch (value->get_type())
+	{
+		case godot::Variant::POOL_BYTE_ARRAY:
+		{
+			*value = gdn::encode(gdn::decode<std::vector<uint8_t>>(godot::PoolByteArray(*value)));
+			return;
+		}
+		case godot::Variant::POOL_COLOR_ARRAY:
+		{
+			*value = gdn::encode(gdn::decode<std::vector<godot::Color>>(godot::PoolColorArray(*value)));
+			return;
+		}
+		case godot::Variant::ARRAY:
+		{
+			godot::Array array { *value };
+
+			for (int i = 0; i < array.size(); i++)
+			{
+				make_json_safe(&array[i]);
+			}
+
+			return;
+		}
+		case godot::Variant::DICTIONARY:
+		{
+			godot::Dictionary dictionary { *value };
+
+			const auto keys { dictionary.keys() };
+
+			for (int i = 0; i < keys.size(); i++)
+			{
+				make_json_safe(&dictionary[keys[i]]);
+			}
+
+			return;
+		}
+		default: return;
+	}
+}
+
+} // detail
+
+// Read-only view of one encoded value. Doesn't own the memory
+class Value
+{
+public:
+
+	Value() = default;
+	Value(const uint8_t* data, const uint8_t* end);
+
+	auto get_tag() const -> Tag;
+	auto is_nil() const -> bool;
+
+	// Total encoded size, tag included
+	auto size_bytes() const -> size_t;
+
+	auto as_bool() const -> bool;
+	auto as_int() const -> int64_t;
+	auto as_float() const -> double;
+	auto as_string() const -> godot::String;
+	auto as_color() const -> godot::Color;
+	auto as_transform2d() const -> godot::Transform2D;
+
+	// Pool arrays, copied out in bulk
+	template <pool_element T> auto as_vector() const -> std::vector<T>;
+	template <pool_element T> auto as_pool_array() const -> typename get_pool_array<T>::type;
+
+	// Raw zero-terminated utf8 of a String, without building a godot::String
+	auto as_c_string() const -> const char*;
+	auto string_equals(const char* str) const -> bool;
+
+	// Arrays and dictionaries
+	auto size() const -> int;
+
+	// Linear in index, hopping over the preceding elements
+	auto at(int index) const -> Value;
+
+	// Dictionaries with String keys. Compares raw bytes, no allocation
+	auto find(const char* key) const -> std::optional<Value>;
+
+	// Visitor is called with each element (arrays) or key and value
+	// (dictionaries) in order
+	template <typename Visitor> auto visit_array(Visitor visitor) const -> void;
+	template <typename Visitor> auto visit_dictionary_items(Visitor visitor) const -> void;
+
+	auto to_variant() const -> godot::Variant;
+
+private:
+
+	auto payload() const -> const uint8_t*;
+	auto expect(Tag tag) const -> void;
+	auto first_child() const -> const uint8_t*;
+	auto next(const uint8_t* at) const -> const uint8_t*;
+
+	const uint8_t* data_{};
+	const uint8_t* end_{};
+};
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+
+	MappedFile(const std::filesystem::path& path);
+	MappedFile(const MappedFile&) = delete;
+	auto operator=(const MappedFile&) -> MappedFile& = delete;
+	~MappedFile();
+
+	auto data() const -> const uint8_t*;
+	auto size() const -> size_t;
+
+private:
+
+	const uint8_t* data_{};
+	size_t size_{};
+#if defined(_WIN32)
+	HANDLE file_{INVALID_HANDLE_VALUE};
+	HANDLE mapping_{};
+#endif
+};
+
+inline auto encode(const godot::Variant& value) -> std::vector<uint8_t>
+{
+	std::vector<uint8_t> out;
+
+	out.insert(out.end(), MAGIC, MAGIC + sizeof(MAGIC));
+	detail::put(FORMAT_VERSION, &out);
+	detail::write(value, &out);
+
+	return out;
+}
+
+// Root value of an encoded document, checking the header
+inline auto root(const uint8_t* data, size_t size) -> Value
+{
+	if (size < HEADER_SIZE || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0 || detail::peek<uint32_t>(data + 4, data + size) != FORMAT_VERSION)
+	{
+		throw std::runtime_error("Not a binary document");
+	}
+
+	return { data + HEADER_SIZE, data + size };
+}
+
+inline auto decode(const uint8_t* data, size_t size) -> godot::Variant
+{
+	return root(data, size).to_variant();
+}
+
+inline auto decode(const std::vector<uint8_t>& data) -> godot::Variant
+{
+	return decode(data.data(), data.size());
+}
+
+inline auto save(const std::filesystem::path& path, const godot::Variant& value) -> void
+{
+	const auto data { encode(value) };
+
+	std::ofstream file { path, std::ios::binary | std::ios::trunc };
+
+	file.write(reinterpret_cast<const char*>(data.data()), data.size());
+
+	if (!file)
+	{
+		throw std::runtime_error("Couldn't write binary document: " + path.string());
+	}
+}
+
+inline auto load(const std::filesystem::path& path) -> godot::Variant
+{
+	const MappedFile file { path };
+
+	return decode(file.data(), file.size());
+}
+
+// Converters. JSON has no integer type, so ints come back from from_json()
+// as floats; read the result with the json:: getters
+inline auto from_json(godot::String text) -> std::vector<uint8_t>
+{
+	const auto result { godot::JSON::get_singleton()->parse(text) };
+
+	if (result->get_error() != godot::Error::OK)
+	{
+		throw std::runtime_error("Invalid JSON: " + to_std_string(result->get_error_string()));
+	}
+
+	return encode(result->get_result());
+}
+
+inline auto to_json(const uint8_t* data, size_t size) -> godot::String
+{
+	auto document { decode(data, size) };
+
+	detail::make_json_safe(&document);
+
+	return godot::JSON::get_singleton()->print(document);
+}
+
+// +++ Value ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+inline Value::Value(const uint8_t* data, const uint8_t* end)
+	: data_{data}
+	, end_{end}
+{
+	if (data_ >= end_) detail::corrupt();
+	if (size_t(end_ - data_) < size_bytes()) detail::corrupt();
+}
+
+inline auto Value::get_tag() const -> Tag
+{
+	return Tag(*data_);
+}
+
+inline auto Value::is_nil() const -> bool
+{
+	return get_tag() == Tag::nil;
+}
+
+inline auto Value::size_bytes() const -> size_t
+{
+	return 1 + detail::payload_size(get_tag(), payload(), end_);
+}
+
+inline auto Value::as_bool() const -> bool
+{
+	expect(Tag::boolean);
+	return *payload() != 0;
+}
+
+inline auto Value::as_int() const -> int64_t
+{
+	expect(Tag::integer);
+	return detail::peek<int64_t>(payload(), end_);
+}
+
+// Accepts ints too, as JSON-sourced documents store every number as a float
+inline auto Value::as_float() const -> double
+{
+	if (get_tag() == Tag::integer) return double(as_int());
+
+	expect(Tag::real);
+	return detail::peek<double>(payload(), end_);
+}
+
+inline auto Value::as_string() const -> godot::String
+{
+	return godot::String(as_c_string());
+}
+
+inline auto Value::as_color() const -> godot::Color
+{
+	expect(Tag::color);
+
+	const auto at { payload() };
+
+	godot::Color out;
+
+	out.r = detail::peek<float>(at, end_);
+	out.g = detail::peek<float>(at + 4, end_);
+	out.b = detail::peek<float>(at + 8, end_);
+	out.a = detail::peek<float>(at + 12, end_);
+
+	return out;
+}
+
+inline auto Value::as_transform2d() const -> godot::Transform2D
+{
+	expect(Tag::transform2d);
+
+	const auto at { payload() };
+
+	godot::Transform2D out { godot::Transform2D::IDENTITY };
+
+	for (int i = 0; i < 3; i++)
+	{
+		out[i][0] = detail::peek<float>(at + i * 8, end_);
+		out[i][1] = detail::peek<float>(at + i * 8 + 4, end_);
+	}
+
+	return out;
+}
+
+template <pool_element T>
+auto Value::as_vector() const -> std::vector<T>
+{
+	expect(get_pool_tag<T>::value);
+
+	std::vector<T> out(detail::peek<uint32_t>(payload(), end_));
+
+	if (!out.empty())
+	{
+		std::memcpy(out.data(), payload() + 4, out.size() * sizeof(T));
+	}
+
+	return out;
+}
+
+template <pool_element T>
+auto Value::as_pool_array() const -> typename get_pool_array<T>::type
+{
+	expect(get_pool_tag<T>::value);
+
+	const auto count { detail::peek<uint32_t>(payload(), end_) };
+
+	typename get_pool_array<T>::type out;
+
+	out.resize(int(count));
+
+	if (count > 0)
+	{
+		auto write { out.write() };
+
+		std::memcpy(write.ptr(), payload() + 4, count * sizeof(T));
+	}
+
+	return out;
+}
+
+inline auto Value::as_c_string() const -> const char*
+{
+	expect(Tag::string);
+
+	const auto str { reinterpret_cast<const char*>(payload() + 4) };
+
+	if (str[detail::peek<uint32_t>(payload(), end_)] != 0) detail::corrupt();
+
+	return str;
+}
+
+inline auto Value::string_equals(const char* str) const -> bool
+{
+	if (get_tag() != Tag::string) return false;
+
+	const auto size { detail::peek<uint32_t>(payload(), end_) };
+
+	return std::strlen(str) == size && std::memcmp(payload() + 4, str, size) == 0;
+}
+
+inline auto Value::size() const -> int
+{
+	if (get_tag() != Tag::array) expect(Tag::dictionary);
+
+	const auto count { detail::peek<uint32_t>(payload() + 4, end_) };
+
+	// Every value takes at least a byte
+	if (count > detail::peek<uint32_t>(payload(), end_)) detail::corrupt();
+
+	return int(count);
+}
+
+inline auto Value::at(int index) const -> Value
+{
+	expect(Tag::array);
+
+	if (index < 0 || index >= size())
+	{
+		throw std::out_of_range("Binary array index out of range");
+	}
+
+	auto at { first_child() };
+
+	for (int i = 0; i < index; i++)
+	{
+		at = next(at);
+	}
+
+	return { at, end_ };
+}
+
+inline auto Value::find(const char* key) const -> std::optional<Value>
+{
+	expect(Tag::dictionary);
+
+	auto at { first_child() };
+
+	for (int i = 0; i < size(); i++)
+	{
+		const Value k { at, end_ };
+		const auto v { next(at) };
+
+		if (k.string_equals(key)) return Value{ v, end_ };
+
+		at = next(v);
+	}
+
+	return std::nullopt;
+}
+
+template <typename Visitor>
+auto Value::visit_array(Visitor visitor) const -> void
+{
+	expect(Tag::array);
+
+	auto at { first_child() };
+
+	for (int i = 0; i < size(); i++)
+	{
+		const Value item { at, end_ };
+
+		visitor(item);
+		at = next(at);
+	}
+}
+
+template <typename Visitor>
+auto Value::visit_dictionary_items(Visitor visitor) const -> void
+{
+	expect(Tag::dictionary);
+
+	auto at { first_child() };
+
+	for (int i = 0; i < size(); i++)
+	{
+		const Value key { at, end_ };
+		const Value value { next(at), end_ };
+
+		visitor(key, value);
+		at = next(value.data_);
+	}
+}
+
+inline auto Value::to_variant() const -> godot::Variant
+{
+	switch (get_tag())
+	{
+		case Tag::nil: return {};
+		case Tag::boolean: return as_bool();
+		case Tag::integer: return as_int();
+		case Tag::real: return as_float();
+		case Tag::string: return as_string();
+		case Tag::color: return as_color();
+		case Tag::transform2d: return as_transform2d();
+		case Tag::array:
+		{
+			godot::Array out;
+
+			out.resize(size());
+
+			auto i { 0 };
+
+			visit_array([&out, &i](Value item) { out[i++] = item.to_variant(); });
+
+			return out;
+		}
+		case Tag::dictionary:
+		{
+			godot::Dictionary out;
+
+			visit_dictionary_items([&out](Value key, Value value) { out[key.to_variant()] = value.to_variant(); });
+
+			return out;
+		}
+		case Tag::pool_byte_array: return as_pool_array<uint8_t>();
+		case Tag::pool_int_array: return as_pool_array<int32_t>();
+		case Tag::pool_real_array: return as_pool_array<float>();
+		case Tag::pool_color_array: return as_pool_array<godot::Color>();
+	}
+
+	detail::corrupt();
+	return {};
+}
+
+inline auto Value::payload() const -> const uint8_t*
+{
+	return data_ + 1;
+}
+
+inline auto Value::expect(Tag tag) const -> void
+{
+	if (get_tag() != tag)
+	{
+		throw std::runtime_error("Unexpected type in binary document");
+	}
+}
+
+inline auto Value::first_child() const -> const uint8_t*
+{
+	return payload() + 8;
+}
+
+inline auto Value::next(const uint8_t* at) const -> const uint8_t*
+{
+	return at + Value{ at, end_ }.size_bytes();
+}
+
+// +++ MappedFile +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+#if defined(_WIN32)
+inline MappedFile::MappedFile(const std::filesystem::path& path)
+{
+	file_ = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	LARGE_INTEGER size;
+
+	if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size))
+	{
+		if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+		throw std::runtime_error("Couldn't open file: " + path.string());
+	}
+
+	size_ = size_t(size.QuadPart);
+
+	if (size_ == 0) return;
+
+	mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	data_ = mapping_ ? static_cast<const uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+
+	if (!data_)
+	{
+		if (mapping_) CloseHandle(mapping_);
+		CloseHandle(file_);
+		throw std::runtime_error("Couldn't map file: " + path.string());
+	}
+}
+
+inline MappedFile::~MappedFile()
+{
+	if (data_) UnmapViewOfFile(data_);
+	if (mapping_) CloseHandle(mapping_);
+	CloseHandle(file_);
+}
+#else
+inline MappedFile::MappedFile(const std::filesystem::path& path)
+{
+	const auto fd { ::open(path.c_str(), O_RDONLY) };
+
+	struct stat info;
+
+	if (fd < 0 || ::fstat(fd, &info) != 0)
+	{
+		if (fd >= 0) ::close(fd);
+		throw std::runtime_error("Couldn't open file: " + path.string());
+	}
+
+	size_ = size_t(info.st_size);
+
+	if (size_ > 0)
+	{
+		const auto data { ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0) };
+
+		if (data == MAP_FAILED)
+		{
+			::close(fd);
+			throw std::runtime_error("Couldn't map file: " + path.string());
+		}
+
+		data_ = static_cast<const uint8_t*>(data);
+	}
+
+	// The mapping stays valid after the descriptor is closed
+	::close(fd);
+}
+
+inline MappedFile::~MappedFile()
+{
+	if (data_) ::munmap(const_cast<uint8_t*>(data_), size_);
+}
+#endif
+
+inline auto MappedFile::data() const -> const uint8_t*
+{
+	return data_;
+}
+
+inline auto MappedFile::size() const -> size_t
+{
+	return size_;
+}
+
+} // binary
+} // gdn
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "struct_codec.hpp"
+
+namespace gdn {
+
+// Converts an Array of same-shaped records to one vector per field and
+// back, for data that is processed a field at a time:
+//
+//   static const auto notes_codec { gdn::make_column_codec(
+//     gdn::column<float>("time"),
+//     gdn::column<int32_t>("pitch"),
+//     gdn::column<float>("velocity", 1.0f)) };
+//
+//   auto [times, pitches, velocities] { notes_codec.decode(data["notes"]) };
+//
+//   for (auto& time : times) time += offset;
+//
+//   data["notes"] = notes_codec.encode({ times, pitches, velocities });
+//
+// Decoding walks each record once, matching keys the same way StructCodec
+// does. A column with a default is filled with it when a record doesn't
+// have the field, and encode() leaves the field out of records where it
+// holds the default, like write_if_not_default(); a record missing any
+// other field throws. Values are encoded the same way as StructCodec
+// fields.
+template <typename T>
+struct Column
+{
+	const char* name;
+	std::optional<T> default_value;
+};
+
+template <typename T>
+auto column(const char* name) -> Column<T>
+{
+	return { name, std::nullopt };
+}
+
+template <typename T>
+auto column(const char* name, T default_value) -> Column<T>
+{
+	return { name, std::move(default_value) };
+}
+
+template <typename ...Types>
+class ColumnCodec
+{
+public:
+
+	using Table = std::tuple<std::vector<Types>...>;
+
+	ColumnCodec(Column<Types>... columns);
+
+	auto encode(const Table& table) const -> godot::Array;
+	auto decode(godot::Array records) const -> Table;
+	auto decode_json(godot::Array records) const -> Table;
+
+	template <typename Getter>
+	auto decode(godot::Array records) const -> Table;
+
+private:
+
+	static constexpr auto SIZE { sizeof...(Types) };
+
+	template <typename Getter, size_t ...I>
+	auto decode(godot::Dictionary record, size_t row, Table* out, std::index_sequence<I...>) const -> void;
+
+	std::tuple<Column<Types>...> columns_;
+	std::array<godot::Variant, SIZE> variant_keys_;
+};
+
+template <typename ...Types>
+auto make_column_codec(Column<Types>... columns) -> ColumnCodec<Types...>
+{
+	return { columns... };
+}
+
+// +++ ColumnCodec ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+template <typename ...Types>
+ColumnCodec<Types...>::ColumnCodec(Column<Types>... columns)
+	: columns_{columns...}
+	, variant_keys_{godot::Variant(godot::String(columns.name))...}
+{
+}
+
+template <typename ...Types>
+auto ColumnCodec<Types...>::encode(const Table& table) const -> godot::Array
+{
+	const auto rows { std::get<0>(table).size() };
+
+	std::apply([rows](const auto&... column)
+	{
+		if (((column.size() != rows) || ...))
+		{
+			throw std::runtime_error("Columns have different lengths");
+		}
+	}, table);
+
+	godot::Array out;
+
+	out.resize(int(rows));
+
+	for (size_t row = 0; row < rows; row++)
+	{
+		godot::Dictionary record;
+
+		[&]<size_t ...I>(std::index_sequence<I...>)
+		{
+			const auto write = [&](const auto& column, const godot::Variant& key, const auto& value)
+			{
+				if (column.default_value && value == *column.default_value) return;
+
+				record[key] = detail::encode_field(value);
+			};
+
+			(write(std::get<I>(columns_), variant_keys_[I], std::get<I>(table)[row]), ...);
+		}(std::index_sequence_for<Types...>{});
+
+		out[int(row)] = record;
+	}
+
+	return out;
+}
+
+template <typename ...Types>
+auto ColumnCodec<Types...>::decode(godot::Array records) const -> Table
+{
+	return decode<detail::getter>(records);
+}
+
+template <typename ...Types>
+auto ColumnCodec<Types...>::decode_json(godot::Array records) const -> Table
+{
+	return decode<detail::json_getter>(records);
+}
+
+template <typename ...Types>
+template <typename Getter>
+auto ColumnCodec<Types...>::decode(godot::Array records) const -> Table
+{
+	const auto rows { size_t(records.size()) };
+
+	Table out;
+
+	std::apply([rows](auto&... column) { (column.resize(rows), ...); }, out);
+
+	for (size_t row = 0; row < rows; row++)
+	{
+		decode<Getter>(Getter{}.template get<godot::Dictionary>(records[int(row)]), row, &out, std::index_sequence_for<Types...>{});
+	}
+
+	return out;
+}
+
+template <typename ...Types>
+template <typename Getter, size_t ...I>
+auto ColumnCodec<Types...>::decode(godot::Dictionary record, size_t row, Table* out, std::index_sequence<I...>) const -> void
+{
+	std::array<bool, SIZE> found{};
+	size_t next{0};
+
+	for_each_item(record, [&](const godot::Variant& key, const godot::Variant& value)
+	{
+		if (key.get_type() != godot::Variant::STRING) return;
+
+		const auto index { detail::find_key(variant_keys_, key, next) };
+
+		if (index == SIZE) return;
+
+		((I == index ? void(std::get<I>(*out)[row] = detail::decode_field<Types, Getter>(value)) : void()), ...);
+
+		found[index] = true;
+		next = index + 1;
+	});
+
+	const auto fill = [&](const auto& column, auto& values, size_t index)
+	{
+		if (found[index]) return;
+
+		if (!column.default_value)
+		{
+			throw std::runtime_error("Missing field: " + std::string(column.name) + " in record " + std::to_string(row));
+		}
+
+		values[row] = *column.default_value;
+	};
+
+	(fill(std::get<I>(columns_), std::get<I>(*out), I), ...);
+}
+
+} // gdn
@@ -1,11 +1,16 @@
 #pragma once
 
 #include <cassert>
+#include <cstring>
 #include <optional>
 #include <stdexcept>
+#include <string>
+#include <type_traits>
 #include <vector>
 #include <Array.hpp>
 #include <Dictionary.hpp>
+#include <GodotGlobal.hpp>
+#include <PoolArrays.hpp>
 #include <Transform2D.hpp>
 
 namespace gdn {
@@ -20,6 +25,27 @@ template <> struct get_type_id<godot::Array>{ static constexpr auto value { godo
 template <> struct get_type_id<godot::Color>{ static constexpr auto value { godot::Variant::COLOR }; };
 template <> struct get_type_id<godot::Dictionary>{ static constexpr auto value { godot::Variant::DICTIONARY }; };
 template <> struct get_type_id<godot::String>{ static constexpr auto value { godot::Variant::STRING }; };
+template <> struct get_type_id<godot::PoolByteArray>{ static constexpr auto value { godot::Variant::POOL_BYTE_ARRAY }; };
+template <> struct get_type_id<godot::PoolIntArray>{ static constexpr auto value { godot::Variant::POOL_INT_ARRAY }; };
+template <> struct get_type_id<godot::PoolRealArray>{ static constexpr auto value { godot::Variant::POOL_REAL_ARRAY }; };
+template <> struct get_type_id<godot::PoolColorArray>{ static constexpr auto value { godot::Variant::POOL_COLOR_ARRAY }; };
+
+// Element types whose vectors decode from a Pool*Array with one bulk copy
+template <typename T> struct get_pool_array{};
+template <> struct get_pool_array<uint8_t>{ using type = godot::PoolByteArray; };
+template <> struct get_pool_array<int32_t>{ using type = godot::PoolIntArray; };
+template <> struct get_pool_array<float>{ using type = godot::PoolRealArray; };
+template <> struct get_pool_array<godot::Color>{ using type = godot::PoolColorArray; };
+
+template <typename T>
+concept pool_element = requires { typename get_pool_array<T>::type; };
+
+// The subset that encode() also writes as pool arrays, rather than an Array
+// of boxed Variants. Godot 3's JSON.print only writes int and real pool
+// arrays as JSON arrays; byte and color ones come out as strings, so those
+// vectors are still encoded as Arrays.
+template <typename T>
+concept packed_element = pool_element<T> && (std::is_same_v<T, int32_t> || std::is_same_v<T, float>);
 
 template <typename T>
 struct get_json_type_id
@@ -69,8 +95,99 @@ inline auto decode<godot::Transform2D, godot::Array>(godot::Array data) -> godot
 
 namespace detail {
 
+template <typename T>
+auto from_pool_array(typename get_pool_array<T>::type data) -> std::vector<T>
+{
+	std::vector<T> out(data.size());
+
+	if (!out.empty())
+	{
+		const auto read { data.read() };
+
+		std::memcpy(out.data(), read.ptr(), out.size() * sizeof(T));
+	}
+
+	return out;
+}
+
+// Also accepts the Array of elements older encoders wrote, and that a
+// JSON round trip turns pool arrays into
+template <typename T>
+auto decode_vector(const godot::Variant& data) -> std::vector<T>
+{
+	if (data.get_type() == get_type_id<typename get_pool_array<T>::type>::value)
+	{
+		return from_pool_array<T>(data);
+	}
+
+	if (data.get_type() != godot::Variant::ARRAY)
+	{
+		throw std::runtime_error("Expected an Array or pool array but got a Variant of type " + std::to_string(int(data.get_type())));
+	}
+
+	const godot::Array array { data };
+
+	std::vector<T> out;
+
+	out.reserve(array.size());
+
+	for (int i = 0; i < array.size(); i++)
+	{
+		if constexpr (std::is_same_v<T, godot::Color>)
+		{
+			out.push_back(gdn::decode<godot::Color>(godot::Array(array[i])));
+		}
+		else if constexpr (std::is_integral_v<T>)
+		{
+			out.push_back(T(int64_t(array[i])));
+		}
+		else
+		{
+			out.push_back(T(array[i]));
+		}
+	}
+
+	return out;
+}
+
+} // detail
+
+template <>
+inline auto decode<std::vector<uint8_t>, godot::PoolByteArray>(godot::PoolByteArray data) -> std::vector<uint8_t>
+{
+	return detail::from_pool_array<uint8_t>(data);
+}
+
+template <>
+inline auto decode<std::vector<int32_t>, godot::PoolIntArray>(godot::PoolIntArray data) -> std::vector<int32_t>
+{
+	return detail::from_pool_array<int32_t>(data);
+}
+
+template <>
+inline auto decode<std::vector<float>, godot::PoolRealArray>(godot::PoolRealArray data) -> std::vector<float>
+{
+	return detail::from_pool_array<float>(data);
+}
+
+template <>
+inline auto decode<std::vector<godot::Color>, godot::PoolColorArray>(godot::PoolColorArray data) -> std::vector<godot::Color>
+{
+	return detail::from_pool_array<godot::Color>(data);
+}
+
+namespace detail {
+
 struct getter
 {
+	template <typename T>
+	static auto get(const godot::Variant& value) -> T
+	{
+		assert (value.get_type() == get_type_id<T>::value);
+
+		return value;
+	}
+
 	template <typename T>
 	static auto get(godot::Dictionary data, godot::String key) -> T
 	{
@@ -90,6 +207,14 @@ struct getter
 
 struct json_getter
 {
+	template <typename T>
+	static auto get(const godot::Variant& value) -> T
+	{
+		assert (value.get_type() == get_json_type_id<T>::value);
+
+		return value;
+	}
+
 	template <typename T>
 	static auto get(godot::Dictionary data, godot::String key) -> T
 	{
@@ -136,6 +261,12 @@ static auto get(godot::Dictionary data, godot::String key, identity<godot::Trans
 	return gdn::decode<godot::Transform2D>(get<godot::Array, Getter>(data, key));
 }
 
+template <typename Getter, pool_element T>
+static auto get(godot::Dictionary data, godot::String key, identity<std::vector<T>>) -> std::vector<T>
+{
+	return decode_vector<T>(data[key]);
+}
+
 template <typename T, typename Getter>
 static auto get(godot::Dictionary data, godot::String key) -> T
 {
@@ -204,6 +335,23 @@ inline auto encode(const std::vector<T>& items) -> godot::Array
 	return out;
 }
 
+template <packed_element T>
+inline auto encode(const std::vector<T>& items) -> typename get_pool_array<T>::type
+{
+	typename get_pool_array<T>::type out;
+
+	out.resize(int(items.size()));
+
+	if (!items.empty())
+	{
+		auto write { out.write() };
+
+		std::memcpy(write.ptr(), items.data(), items.size() * sizeof(T));
+	}
+
+	return out;
+}
+
 template <typename T>
 static auto get(godot::Dictionary data, godot::String key) -> T
 {
@@ -248,21 +396,40 @@ static auto visit_array(godot::Array array, Visitor visitor) -> void
 	return detail::visit_array<T, Visitor, detail::json_getter>(array, visitor);
 }
 
-template <typename KeyType, typename ValueType, typename Visitor>
-static auto visit_dictionary_items(godot::Dictionary d, Visitor visitor) -> void
+// Calls visitor(key, value) for each item in insertion order, walking the
+// dictionary's own storage like GDScript's for loop does. Unlike keys() and
+// d[key] this doesn't build a key Array or copy anything, and can't insert
+// missing keys. The GDNative API only steps from key to key, so each value
+// is still one hash lookup. The visitor mustn't add or erase items, which
+// would leave the walk pointing at freed storage.
+template <typename Visitor>
+auto for_each_item(const godot::Dictionary& d, Visitor visitor) -> void
 {
-	const auto keys { d.keys() };
+	static_assert (sizeof(godot::Dictionary) == sizeof(godot_dictionary));
+	static_assert (sizeof(godot::Variant) == sizeof(godot_variant));
+
+	const auto self { reinterpret_cast<const godot_dictionary*>(&d) };
 
-	for (int i = 0; i < keys.size(); i++)
+	for (auto key { godot::api->godot_dictionary_next(self, nullptr) }; key; key = godot::api->godot_dictionary_next(self, key))
 	{
-		const auto key { keys[i] };
-		const auto value { d[key] };
+		const auto value { godot::api->godot_dictionary_operator_index_const(self, key) };
 
+		visitor(*reinterpret_cast<const godot::Variant*>(key), *reinterpret_cast<const godot::Variant*>(value));
+	}
+}
+
+// Walks d with for_each_item(), so the visitor mustn't add or erase items
+// of d; collect them and apply the changes afterwards
+template <typename KeyType, typename ValueType, typename Visitor>
+static auto visit_dictionary_items(godot::Dictionary d, Visitor visitor) -> void
+{
+	for_each_item(d, [&visitor](const godot::Variant& key, const godot::Variant& value)
+	{
 		assert (get_type_id<KeyType>::value == key.get_type());
 		assert (get_type_id<ValueType>::value == value.get_type());
 
 		visitor(key, value);
-	}
+	});
 }
 
 template <typename T>
@@ -300,10 +467,11 @@ static auto write_if_has_value(godot::String key, godot::Dictionary value, godot
 }
 
 inline auto get_first_key(godot::Dictionary d) -> godot::Variant {
-	if (d.keys().empty()) {
-		return {};
+	const auto self = reinterpret_cast<const godot_dictionary*>(&d);
+	if (const auto key = godot::api->godot_dictionary_next(self, nullptr)) {
+		return *reinterpret_cast<const godot::Variant*>(key);
 	}
-	return d.keys()[0];
+	return {};
 }
 
 inline auto must_get_first_key(godot::Dictionary d) -> godot::Variant {
@@ -349,21 +517,18 @@ auto visit_array(godot::Array array, Visitor visitor) -> void {
 	return detail::visit_array<T, Visitor, detail::json_getter>(array, visitor);
 }
 
+// Same as gdn::visit_dictionary_items(), including that the visitor
+// mustn't add or erase items of d
 template <typename KeyType, typename ValueType, typename Visitor>
 static auto visit_dictionary_items(godot::Dictionary d, Visitor visitor) -> void
 {
-	const auto keys { d.keys() };
-
-	for (int i = 0; i < keys.size(); i++)
+	for_each_item(d, [&visitor](const godot::Variant& key, const godot::Variant& value)
 	{
-		const auto key { keys[i] };
-		const auto value { d[key] };
-
 		assert (get_type_id<godot::String>::value == key.get_type());
 		assert (get_type_id<ValueType>::value == value.get_type());
 
 		visitor(from_string<KeyType>(key), value);
-	}
+	});
 }
 
 } // json
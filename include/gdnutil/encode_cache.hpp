@@ -0,0 +1,261 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <Variant.hpp>
+
+namespace gdn {
+
+// Remembers the encoded subtree of each model object so that a save only
+// re-encodes the objects that changed since the last one:
+//
+//   auto encode_clip(const Clip& clip) -> godot::Dictionary
+//   {
+//     godot::Dictionary out;
+//     write_if_not_default("gain", clip.gain, 1.0f, &out);
+//     ...
+//     return out;
+//   }
+//
+//   auto encode_track(const Track& track) -> godot::Dictionary
+//   {
+//     godot::Array clips;
+//     for (const auto& clip : track.clips)
+//     {
+//       clips.append(cache.get(clip.id, [&] { return encode_clip(clip); }));
+//     }
+//     ...
+//   }
+//
+//   // whenever the model changes
+//   cache.set_dirty(clip.id);
+//
+// Objects encoded from inside another object's encode function are
+// remembered as its children, and dirtying a child dirties every object
+// above it, since their cached subtrees hold the child's old one; so does
+// encoding an object under a different parent than before. An unchanged
+// object returns its previous subtree without even visiting its children,
+// so the work done per save is proportional to the edit rather than to
+// the model.
+//
+// Cached subtrees are shared with every document built from them, so
+// documents must be treated as read-only once built.
+template <typename Key, typename Hash = std::hash<Key>>
+class EncodeCache
+{
+public:
+
+	template <typename Encode>
+	auto get(const Key& key, Encode&& encode) -> godot::Variant;
+
+	auto set_dirty(const Key& key) -> void;
+	auto set_all_dirty() -> void;
+
+	// Forgets a deleted object. Its parent is dirtied, and its children are
+	// orphaned until they're next encoded under a parent
+	auto erase(const Key& key) -> void;
+	auto clear() -> void;
+
+	auto is_dirty(const Key& key) const -> bool;
+	auto size() const -> size_t;
+
+	// Number of objects encoded by get() since the last reset
+	auto get_encode_count() const -> size_t;
+	auto reset_encode_count() -> void;
+
+private:
+
+	struct Entry
+	{
+		godot::Variant data;
+		const Key* parent{};
+		std::vector<const Key*> children;
+		size_t child_index{}; // in the parent's children
+		bool dirty{true};
+	};
+
+	auto set_dirty(Entry* entry) -> void;
+	auto set_parent(const Key* key, Entry* entry, const Key* parent) -> void;
+	auto find(const Key* key) -> Entry*;
+
+	std::unordered_map<Key, Entry, Hash> entries_;
+	std::vector<const Key*> encoding_;
+	size_t encode_count_{0};
+};
+
+// +++ EncodeCache ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+template <typename Key, typename Hash>
+template <typename Encode>
+auto EncodeCache<Key, Hash>::get(const Key& key, Encode&& encode) -> godot::Variant
+{
+	// Node keys stay put when the map rehashes, so parents can point at them
+	auto& [stored_key, entry] { *entries_.try_emplace(key).first };
+
+	const auto parent { encoding_.empty() ? nullptr : encoding_.back() };
+
+	if (entry.parent != parent)
+	{
+		// The old parent's cached subtree still holds this one
+		if (const auto old_parent { find(entry.parent) })
+		{
+			set_dirty(old_parent);
+		}
+
+		set_parent(&stored_key, &entry, parent);
+	}
+
+	if (!entry.dirty) return entry.data;
+
+	struct Scope
+	{
+		std::vector<const Key*>* encoding;
+		~Scope() { encoding->pop_back(); }
+	};
+
+	encoding_.push_back(&stored_key);
+
+	Scope scope { &encoding_ };
+
+	// Cleared first, so that if a child moving here from elsewhere dirties
+	// its old parent and so this one, this stays dirty for the next save
+	entry.dirty = false;
+
+	try
+	{
+		entry.data = std::forward<Encode>(encode)();
+	}
+	catch (...)
+	{
+		entry.dirty = true;
+		throw;
+	}
+
+	encode_count_++;
+
+	return entry.data;
+}
+
+template <typename Key, typename Hash>
+auto EncodeCache<Key, Hash>::set_dirty(const Key& key) -> void
+{
+	const auto pos { entries_.find(key) };
+
+	if (pos == entries_.end()) return;
+
+	set_dirty(&pos->second);
+}
+
+template <typename Key, typename Hash>
+auto EncodeCache<Key, Hash>::set_dirty(Entry* entry) -> void
+{
+	for (;;)
+	{
+		entry->dirty = true;
+
+		entry = find(entry->parent);
+
+		// Everything above a dirty entry is already dirty
+		if (!entry || entry->dirty) return;
+	}
+}
+
+// Moves key from its current parent's children to parent's, in constant
+// time by swapping the last sibling into its place
+template <typename Key, typename Hash>
+auto EncodeCache<Key, Hash>::set_parent(const Key* key, Entry* entry, const Key* parent) -> void
+{
+	if (const auto old_parent { find(entry->parent) })
+	{
+		auto& siblings { old_parent->children };
+		const auto last { siblings.back() };
+
+		siblings[entry->child_index] = last;
+		find(last)->child_index = entry->child_index;
+		siblings.pop_back();
+	}
+
+	entry->parent = parent;
+
+	if (const auto new_parent { find(parent) })
+	{
+		entry->child_index = new_parent->children.size();
+		new_parent->children.push_back(key);
+	}
+}
+
+template <typename Key, typename Hash>
+auto EncodeCache<Key, Hash>::find(const Key* key) -> Entry*
+{
+	if (!key) return nullptr;
+
+	const auto pos { entries_.find(*key) };
+
+	return pos == entries_.end() ? nullptr : &pos->second;
+}
+
+template <typename Key, typename Hash>
+auto EncodeCache<Key, Hash>::set_all_dirty() -> void
+{
+	for (auto& [key, entry] : entries_)
+	{
+		entry.dirty = true;
+	}
+}
+
+template <typename Key, typename Hash>
+auto EncodeCache<Key, Hash>::erase(const Key& key) -> void
+{
+	const auto pos { entries_.find(key) };
+
+	if (pos == entries_.end()) return;
+
+	auto& entry { pos->second };
+
+	set_dirty(&entry);
+	set_parent(&pos->first, &entry, nullptr);
+
+	for (const auto child : entry.children)
+	{
+		find(child)->parent = nullptr;
+	}
+
+	entries_.erase(pos);
+}
+
+template <typename Key, typename Hash>
+auto EncodeCache<Key, Hash>::clear() -> void
+{
+	entries_.clear();
+}
+
+template <typename Key, typename Hash>
+auto EncodeCache<Key, Hash>::is_dirty(const Key& key) const -> bool
+{
+	const auto pos { entries_.find(key) };
+
+	return pos == entries_.end() || pos->second.dirty;
+}
+
+template <typename Key, typename Hash>
+auto EncodeCache<Key, Hash>::size() const -> size_t
+{
+	return entries_.size();
+}
+
+template <typename Key, typename Hash>
+auto EncodeCache<Key, Hash>::get_encode_count() const -> size_t
+{
+	return encode_count_;
+}
+
+template <typename Key, typename Hash>
+auto EncodeCache<Key, Hash>::reset_encode_count() -> void
+{
+	encode_count_ = 0;
+}
+
+} // gdn
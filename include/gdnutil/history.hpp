@@ -1,10 +1,29 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstring>
+#include <deque>
 #include <functional>
+#include <map>
 #include <memory>
-#include <variant>
+#include <new>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <Array.hpp>
+#include <Dictionary.hpp>
+#include <Object.hpp>
+#include <PoolArrays.hpp>
+#include <Reference.hpp>
 #include <UndoRedo.hpp>
+#include "objects.hpp"
+#include "string_helpers.hpp"
 
 namespace gdn {
 
@@ -20,14 +39,242 @@ struct HistoryCallbacks
 	std::function<void(int64_t version)> pre_undo;
 };
 
+struct HistoryUsage
+{
+	size_t actions{};
+	size_t bytes{};
+	size_t evicted_actions{};
+	size_t evicted_bytes{};
+	size_t coalesced_actions{};
+};
+
+// Aggregated cost of one kind of action, see History::set_instrumented()
+struct HistoryActionStats
+{
+	struct Timing
+	{
+		size_t count{};
+		std::chrono::microseconds total{};
+		std::chrono::microseconds max{};
+
+		auto add(std::chrono::steady_clock::duration time) -> void;
+	};
+
+	Timing commit;
+	Timing undo;
+	Timing redo;
+	Timing callbacks;
+	size_t commands{};
+	size_t bytes{};
+};
+
+// A change to the history, as reported to a recorder such as
+// HistoryJournal. merge_mode is the mode the commit actually resolved to,
+// payload is whatever was passed to Action::set_payload(), and branch is
+// the index passed to History::switch_branch().
+struct HistoryRecord
+{
+	enum class Type : uint8_t { commit, undo, redo, clear, branch };
+
+	Type type;
+	int64_t version;
+	int64_t merge_mode;
+	std::string name;
+	std::vector<uint8_t> payload;
+	int64_t branch{};
+};
+
+using HistoryRecorder = std::function<void(HistoryRecord record)>;
+
 namespace detail {
 
+// Rough heap footprint of a Variant, used for history memory accounting
+inline auto approx_size(const godot::Variant& value) -> size_t
+{
+	switch (value.get_type())
+	{
+		case godot::Variant::STRING: return godot::String(value).length() * sizeof(wchar_t);
+		case godot::Variant::POOL_BYTE_ARRAY: return godot::PoolByteArray(value).size();
+		case godot::Variant::POOL_INT_ARRAY: return godot::PoolIntArray(value).size() * sizeof(int);
+		case godot::Variant::POOL_REAL_ARRAY: return godot::PoolRealArray(value).size() * sizeof(float);
+		case godot::Variant::POOL_VECTOR2_ARRAY: return godot::PoolVector2Array(value).size() * sizeof(godot::Vector2);
+		case godot::Variant::POOL_COLOR_ARRAY: return godot::PoolColorArray(value).size() * sizeof(godot::Color);
+		case godot::Variant::ARRAY:
+		{
+			const godot::Array array { value };
+
+			auto out { array.size() * sizeof(godot::Variant) };
+
+			for (int i = 0; i < array.size(); i++)
+			{
+				out += approx_size(array[i]);
+			}
+
+			return out;
+		}
+		case godot::Variant::DICTIONARY:
+		{
+			const godot::Dictionary dictionary { value };
+			const auto keys { dictionary.keys() };
+
+			auto out { keys.size() * sizeof(godot::Variant) * 2 };
+
+			for (int i = 0; i < keys.size(); i++)
+			{
+				out += approx_size(keys[i]) + approx_size(dictionary[keys[i]]);
+			}
+
+			return out;
+		}
+		default: return 0;
+	}
+}
+
+// Native commands which own heap memory can report it by providing
+// approx_size(), otherwise only their inline size is counted
 template <typename T>
-struct delete_godot_object
+concept reports_size = requires (const T& command) {
+	{ command.approx_size() } -> std::convertible_to<size_t>;
+};
+
+// Contiguous, type-erased storage for the do or undo half of an action.
+// Commands are constructed in place and run in the order they were added.
+class CommandList
 {
-	auto operator()(T* o) -> void
+public:
+
+	CommandList() = default;
+	CommandList(const CommandList&) = delete;
+	CommandList(CommandList&& rhs) noexcept;
+	auto operator=(const CommandList&) -> CommandList& = delete;
+	auto operator=(CommandList&& rhs) noexcept -> CommandList&;
+	~CommandList();
+
+	template <typename Fn> auto push(Fn&& fn) -> void;
+	template <typename T> auto reserve(size_t count) -> void;
+	auto append(CommandList&& rhs) -> void;
+	auto clear() -> void;
+	auto empty() const -> bool;
+	auto size() const -> size_t;
+	auto size_bytes() const -> size_t;
+	auto run() -> void;
+
+private:
+
+	struct alignas(std::max_align_t) unit { std::byte bytes[alignof(std::max_align_t)]; };
+
+	struct Header
+	{
+		void (*invoke)(void* command);
+		void (*relocate)(void* from, void* to);
+		void (*destroy)(void* command);
+		size_t units;
+	};
+
+	static constexpr auto HEADER_UNITS { (sizeof(Header) + sizeof(unit) - 1) / sizeof(unit) };
+
+	template <typename T> static constexpr auto units_for() -> size_t;
+	template <typename T> static auto invoke(void* command) -> void;
+	template <typename T> static auto relocate(void* from, void* to) -> void;
+	template <typename T> static auto destroy(void* command) -> void;
+
+	auto header(size_t at) const -> Header*;
+	auto grow(size_t min_units) -> void;
+	auto reallocate(size_t capacity) -> void;
+	auto relocate_into(unit* dest) -> void;
+
+	std::unique_ptr<unit[]> data_;
+	size_t capacity_{};
+	size_t used_{};
+	size_t count_{};
+	size_t heap_bytes_{};
+};
+
+// Godot method call recorded by the Object*/String/Array overloads. Like
+// godot::UndoRedo it holds the instance id, so freed objects are skipped,
+// and a reference to Reference-derived objects, which would otherwise be
+// freed once only the history needed them.
+struct MethodCall
+{
+	MethodCall(godot::Object* object, godot::String method, godot::Array args)
+		: object_id{object->get_instance_id()}
+		, reference{godot::Object::cast_to<godot::Reference>(object)}
+		, method{std::move(method)}
+		, args{std::move(args)}
 	{
-		o->free();
+	}
+
+	godot_int object_id;
+	godot::Ref<godot::Reference> reference;
+	godot::String method;
+	godot::Array args;
+
+	auto operator()() const -> void
+	{
+		if (const auto object { find_instance<godot::Object>(object_id) })
+		{
+			object->callv(method, args);
+		}
+	}
+
+	auto approx_size() const -> size_t
+	{
+		return method.length() * sizeof(wchar_t) + detail::approx_size(args);
+	}
+};
+
+// Builds the argument array for a method call in one allocation
+template <typename ...Args>
+auto make_args(Args&&... args) -> godot::Array
+{
+	godot::Array out;
+
+	if constexpr (sizeof...(Args) > 0)
+	{
+		auto i { 0 };
+
+		out.resize(sizeof...(Args));
+		((out[i++] = godot::Variant(std::forward<Args>(args))), ...);
+	}
+
+	return out;
+}
+
+// One half of a bulk edit. The items are shared between the do and undo
+// halves; fn either takes the whole batch, or is applied to each item (in
+// reverse order for the undo half, so per-item edits unwind correctly).
+template <typename T, typename Fn, bool Reverse>
+struct BulkCall
+{
+	std::shared_ptr<const std::vector<T>> items;
+	Fn fn;
+	size_t reported_bytes;
+
+	auto operator()() -> void
+	{
+		if constexpr (std::invocable<Fn&, const std::vector<T>&>)
+		{
+			fn(*items);
+		}
+		else if constexpr (Reverse)
+		{
+			for (auto item { items->rbegin() }; item != items->rend(); item++)
+			{
+				fn(*item);
+			}
+		}
+		else
+		{
+			for (const auto& item : *items)
+			{
+				fn(item);
+			}
+		}
+	}
+
+	auto approx_size() const -> size_t
+	{
+		return reported_bytes;
 	}
 };
 
@@ -35,28 +282,94 @@ class HistoryBody
 {
 public:
 
-	HistoryBody(HistoryCallbacks callbacks, int64_t length);
+	HistoryBody(HistoryCallbacks callbacks, int64_t length, size_t max_bytes);
 
-	auto add_do(godot::Object* object, godot::String method, godot::Array args) -> void;
-	auto add_undo(godot::Object* object, godot::String method, godot::Array args) -> void;
-	auto create_action(godot::String name, int64_t merge_mode = 0) -> void;
-	auto commit_action() -> void;
+	auto commit_action(godot::String name, godot_int object_id, int64_t merge_mode, CommandList do_commands, CommandList undo_commands, std::vector<uint8_t> payload) -> void;
 	auto clear() -> void;
 	auto has_redo() const -> bool;
 	auto has_undo() const -> bool;
 	auto is_committing() const -> bool;
 	auto get_current_action_name() const -> godot::String;
 	auto get_version() const -> int64_t;
+	auto get_usage() const -> HistoryUsage;
 	auto redo() -> bool;
 	auto undo() -> bool;
+	auto set_coalesce_window(std::chrono::milliseconds window) -> void;
+	auto set_recorder(HistoryRecorder recorder) -> void;
+	auto set_forced_merge_mode(std::optional<int64_t> merge_mode) -> void;
+	auto set_branching(bool yes) -> void;
+	auto get_branch_count() const -> int64_t;
+	auto get_branch_name(int64_t index) const -> godot::String;
+	auto switch_branch(int64_t index) -> bool;
+	auto set_instrumented(bool yes) -> void;
+	auto get_stats() const -> const std::map<godot::String, HistoryActionStats>&;
+	auto reset_stats() -> void;
 
 private:
 
-	std::unique_ptr<godot::UndoRedo, detail::delete_godot_object<godot::UndoRedo>> ur_;
+	using clock = std::chrono::steady_clock;
+
+	// Same window godot::UndoRedo uses to decide whether an action merges
+	static constexpr auto MERGE_WINDOW { std::chrono::milliseconds{800} };
+
+	struct Branch;
+
+	using Branches = std::vector<std::unique_ptr<Branch>>;
+
+	struct Entry
+	{
+		godot::String name;
+		godot_int object_id;
+		CommandList do_commands;
+		CommandList undo_commands;
+		clock::time_point last_tick;
+
+		// Alternative continuations from the state after this action,
+		// retained when branching is enabled
+		Branches branches;
+
+		auto size_bytes() const -> size_t;
+	};
+
+	// Entries following a shared prefix, which is not duplicated
+	struct Branch
+	{
+		std::deque<Entry> entries;
+		size_t bytes{};
+	};
+
+	static auto size_bytes(const Branches& branches) -> size_t;
+
+	auto redo_entry() -> bool;
+	auto undo_entry() -> bool;
+	auto current_branches() -> Branches&;
+	auto current_branches() const -> const Branches&;
+	auto detach_redo() -> std::unique_ptr<Branch>;
+	auto discard_redo() -> void;
+	auto get_merge_mode(const godot::String& name, godot_int object_id, int64_t merge_mode, clock::time_point now) const -> int64_t;
+	auto evict() -> void;
+	auto record(HistoryRecord::Type type, int64_t merge_mode = 0, godot::String name = {}, std::vector<uint8_t> payload = {}) -> void;
+
+	template <typename Fn> auto measure(Fn&& fn) -> clock::duration;
+
 	HistoryCallbacks callbacks_;
+	HistoryRecorder recorder_;
+	std::optional<int64_t> forced_merge_mode_;
+	std::deque<Entry> entries_;
+	Branches root_branches_;
+	int64_t current_{-1};
+	int64_t version_{1};
 	int64_t length_;
-	int64_t front_{-1};
+	size_t max_bytes_;
+	size_t bytes_{};
+	size_t evicted_actions_{};
+	size_t evicted_bytes_{};
+	size_t coalesced_actions_{};
+	std::chrono::milliseconds coalesce_window_{0};
+	bool branching_{false};
 	bool committing_{false};
+	bool instrumented_{false};
+	std::map<godot::String, HistoryActionStats> stats_;
 };
 
 } // detail
@@ -66,35 +379,47 @@ class Action
 public:
 
 	Action() = default;
-	Action(detail::HistoryBody* body, godot::String name, int64_t merge_mode);
+	Action(detail::HistoryBody* body, godot::String name, int64_t merge_mode, godot_int object_id = 0);
 
 	auto add_do(godot::Object* object, godot::String method, godot::Array args) -> void;
 	auto add_undo(godot::Object* object, godot::String method, godot::Array args) -> void;
 	auto clear() -> void;
 	auto commit() -> void;
 
-	template <typename ...Args> void add_do(godot::Object* object, godot::String method, Args... args);
-	template <typename ...Args> void add_undo(godot::Object* object, godot::String method, Args... args);
+	// True once commit() has been called (or for a default constructed action)
+	auto is_committed() const -> bool;
 
-private:
+	// Preallocates room for the given number of method calls in each half,
+	// for actions whose size is known up front
+	auto reserve(size_t commands) -> void;
 
-	detail::HistoryBody* body_{};
+	template <typename ...Args> void add_do(godot::Object* object, godot::String method, Args&&... args);
+	template <typename ...Args> void add_undo(godot::Object* object, godot::String method, Args&&... args);
 
-	struct CommandBody
-	{
-		godot::Object* object;
-		godot::String method;
-		godot::Array args;
-	};
+	// Native commands are stored inline and called directly on do/undo,
+	// without method name lookup or Variant boxing
+	template <typename Fn> requires std::invocable<Fn&> void add_do(Fn&& fn);
+	template <typename Fn> requires std::invocable<Fn&> void add_undo(Fn&& fn);
 
-	struct Undo : public CommandBody {};
-	struct Redo : public CommandBody {};
+	// Mass edits: the whole batch is one command per half, stored once.
+	// do_fn/undo_fn take either a const T& or the whole const std::vector<T>&.
+	// (For Godot-side batches, pass Pool*Arrays through add_do/add_undo so
+	// the target method is called once with the packed data.)
+	template <typename T, typename DoFn, typename UndoFn> void add_bulk(std::vector<T> items, DoFn do_fn, UndoFn undo_fn);
 
-	using Command = std::variant<Undo, Redo>;
+	// Opaque data handed to the history's recorder along with the commit,
+	// enough for the application to rebuild this action on replay
+	auto set_payload(std::vector<uint8_t> payload) -> void;
 
+private:
+
+	detail::HistoryBody* body_{};
 	godot::String name_;
+	godot_int object_id_;
 	int64_t merge_mode_;
-	std::vector<Command> commands_;
+	detail::CommandList do_;
+	detail::CommandList undo_;
+	std::vector<uint8_t> payload_;
 };
 
 class ObjectAction : public Action
@@ -104,11 +429,15 @@ public:
 	ObjectAction() = default;
 	ObjectAction(detail::HistoryBody* body, godot::Object* object, godot::String name, int64_t merge_mode);
 
+	// Native commands and calls on other objects
+	using Action::add_do;
+	using Action::add_undo;
+
 	auto add_do(godot::String method, godot::Array args) -> void;
 	auto add_undo(godot::String method, godot::Array args) -> void;
 
-	template <typename ...Args> void add_do(godot::String method, Args... args);
-	template <typename ...Args> void add_undo(godot::String method, Args... args);
+	template <typename ...Args> void add_do(godot::String method, Args&&... args);
+	template <typename ...Args> void add_undo(godot::String method, Args&&... args);
 
 private:
 
@@ -149,7 +478,9 @@ class History
 {
 public:
 
-	History(HistoryCallbacks callbacks, int64_t length = -1);
+	// Once there are more than length actions, or they take up more than
+	// max_bytes, the oldest are dropped. Negative/zero means unbounded.
+	History(HistoryCallbacks callbacks, int64_t length = -1, size_t max_bytes = 0);
 
 	auto create_action(godot::String name, int64_t merge_mode = 0) -> Action;
 	auto create_action(godot::Object* object, godot::String name, int64_t merge_mode = 0) -> ObjectAction;
@@ -161,62 +492,357 @@ public:
 	auto is_committing() const -> bool;
 	auto get_current_action_name() const -> godot::String;
 	auto get_version() const -> int64_t;
+	auto get_usage() const -> HistoryUsage;
 	auto redo() -> bool;
 	auto undo() -> bool;
 
+	// Consecutive actions with the same name (and object, if any) committed
+	// within window of each other are folded into one, keeping the undo of
+	// the first and the do of the last. Zero disables it.
+	auto set_coalesce_window(std::chrono::milliseconds window) -> void;
+
+	// The recorder is told about every commit, undo, redo and clear
+	auto set_recorder(HistoryRecorder recorder) -> void;
+
+	// Applies a recorded change. For commits, rebuild is called and must
+	// commit exactly one action from the record; it merges exactly as it
+	// did originally, regardless of timing.
+	template <typename Rebuild>
+	auto replay(const HistoryRecord& record, Rebuild&& rebuild) -> void;
+
+	// With branching on, committing after an undo keeps the redo path as an
+	// alternative branch instead of discarding it
+	auto set_branching(bool yes) -> void;
+
+	// Alternative branches available from the current state, besides the
+	// one redo() follows
+	auto get_branch_count() const -> int64_t;
+	auto get_branch_name(int64_t index) const -> godot::String;
+	auto switch_branch(int64_t index) -> bool;
+
+	// Per action name: commit/undo/redo latency, how much of it was spent
+	// in HistoryCallbacks, and the number and approximate size of commands
+	auto set_instrumented(bool yes) -> void;
+	auto get_stats() const -> const std::map<godot::String, HistoryActionStats>&;
+	auto get_stats_report() const -> godot::Dictionary;
+	auto reset_stats() -> void;
+
 private:
 
 	std::unique_ptr<detail::HistoryBody> body_;
 };
 
+// +++ HistoryActionStats ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+inline auto HistoryActionStats::Timing::add(std::chrono::steady_clock::duration time) -> void
+{
+	const auto usecs { std::chrono::duration_cast<std::chrono::microseconds>(time) };
+
+	count++;
+	total += usecs;
+	max = std::max(max, usecs);
+}
+
 namespace detail {
 
-// +++ HistoryBody +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-inline HistoryBody::HistoryBody(HistoryCallbacks callbacks, int64_t length)
-	: ur_{ godot::UndoRedo::_new() }
-	, callbacks_{callbacks}
-	, length_{length}
+// +++ CommandList +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+inline CommandList::CommandList(CommandList&& rhs) noexcept
+	: data_{std::move(rhs.data_)}
+	, capacity_{std::exchange(rhs.capacity_, 0)}
+	, used_{std::exchange(rhs.used_, 0)}
+	, count_{std::exchange(rhs.count_, 0)}
+	, heap_bytes_{std::exchange(rhs.heap_bytes_, 0)}
 {
 }
 
-inline auto HistoryBody::add_do(godot::Object* object, godot::String method, godot::Array args) -> void
+inline auto CommandList::operator=(CommandList&& rhs) noexcept -> CommandList&
 {
-	ur_->add_do_method(object, method, args);
+	clear();
+
+	data_ = std::move(rhs.data_);
+	capacity_ = std::exchange(rhs.capacity_, 0);
+	used_ = std::exchange(rhs.used_, 0);
+	count_ = std::exchange(rhs.count_, 0);
+	heap_bytes_ = std::exchange(rhs.heap_bytes_, 0);
+
+	return *this;
 }
 
-inline auto HistoryBody::add_undo(godot::Object* object, godot::String method, godot::Array args) -> void
+inline CommandList::~CommandList()
 {
-	ur_->add_undo_method(object, method, args);
+	clear();
 }
 
-inline auto HistoryBody::create_action(godot::String name, int64_t merge_mode) -> void
+template <typename T>
+auto CommandList::invoke(void* command) -> void
+{
+	(*static_cast<T*>(command))();
+}
+
+template <typename T>
+auto CommandList::relocate(void* from, void* to) -> void
+{
+	new (to) T{ std::move(*static_cast<T*>(from)) };
+	static_cast<T*>(from)->~T();
+}
+
+template <typename T>
+auto CommandList::destroy(void* command) -> void
+{
+	static_cast<T*>(command)->~T();
+}
+
+template <typename T>
+constexpr auto CommandList::units_for() -> size_t
+{
+	return HEADER_UNITS + (sizeof(T) + sizeof(unit) - 1) / sizeof(unit);
+}
+
+template <typename Fn>
+auto CommandList::push(Fn&& fn) -> void
+{
+	using T = std::decay_t<Fn>;
+
+	static_assert (alignof(T) <= alignof(unit));
+
+	constexpr auto units { units_for<T>() };
+	constexpr auto trivial { std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T> };
+
+	grow(used_ + units);
+
+	const auto command { new (data_.get() + used_ + HEADER_UNITS) T{ std::forward<Fn>(fn) } };
+
+	new (data_.get() + used_) Header{ &invoke<T>, trivial ? nullptr : &relocate<T>, trivial ? nullptr : &destroy<T>, units };
+
+	if constexpr (reports_size<T>)
+	{
+		heap_bytes_ += command->approx_size();
+	}
+
+	used_ += units;
+	count_++;
+}
+
+// Makes room for count more commands of type T in a single allocation
+template <typename T>
+auto CommandList::reserve(size_t count) -> void
+{
+	const auto units { used_ + count * units_for<T>() };
+
+	if (capacity_ < units)
+	{
+		reallocate(units);
+	}
+}
+
+inline auto CommandList::append(CommandList&& rhs) -> void
+{
+	if (rhs.empty()) return;
+
+	if (empty())
+	{
+		*this = std::move(rhs);
+		return;
+	}
+
+	grow(used_ + rhs.used_);
+	rhs.relocate_into(data_.get() + used_);
+
+	used_ += std::exchange(rhs.used_, 0);
+	count_ += std::exchange(rhs.count_, 0);
+	heap_bytes_ += std::exchange(rhs.heap_bytes_, 0);
+}
+
+inline auto CommandList::clear() -> void
+{
+	for (size_t at = 0; at < used_; at += header(at)->units)
+	{
+		if (const auto destroy { header(at)->destroy })
+		{
+			destroy(data_.get() + at + HEADER_UNITS);
+		}
+	}
+
+	used_ = 0;
+	count_ = 0;
+	heap_bytes_ = 0;
+}
+
+inline auto CommandList::empty() const -> bool
+{
+	return count_ == 0;
+}
+
+inline auto CommandList::size() const -> size_t
+{
+	return count_;
+}
+
+inline auto CommandList::size_bytes() const -> size_t
+{
+	return capacity_ * sizeof(unit) + heap_bytes_;
+}
+
+inline auto CommandList::run() -> void
+{
+	for (size_t at = 0; at < used_; at += header(at)->units)
+	{
+		header(at)->invoke(data_.get() + at + HEADER_UNITS);
+	}
+}
+
+inline auto CommandList::header(size_t at) const -> Header*
+{
+	return std::launder(reinterpret_cast<Header*>(data_.get() + at));
+}
+
+inline auto CommandList::grow(size_t min_units) -> void
+{
+	if (capacity_ >= min_units) return;
+
+	reallocate(std::max(min_units, capacity_ * 2));
+}
+
+inline auto CommandList::reallocate(size_t capacity) -> void
+{
+	auto data { std::make_unique<unit[]>(capacity) };
+
+	relocate_into(data.get());
+
+	data_ = std::move(data);
+	capacity_ = capacity;
+}
+
+// Moves every command into dest, leaving this list's storage dead (but
+// used_ and count_ untouched, the caller decides what they become)
+inline auto CommandList::relocate_into(unit* dest) -> void
+{
+	for (size_t at = 0; at < used_; at += header(at)->units)
+	{
+		const auto from { header(at) };
+		const auto units { from->units };
+
+		if (const auto relocate { from->relocate })
+		{
+			new (dest + at) Header{ *from };
+			relocate(data_.get() + at + HEADER_UNITS, dest + at + HEADER_UNITS);
+		}
+		else
+		{
+			std::memcpy(dest + at, data_.get() + at, units * sizeof(unit));
+		}
+	}
+}
+
+// +++ HistoryBody +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+inline auto HistoryBody::Entry::size_bytes() const -> size_t
+{
+	return sizeof(Entry) + name.length() * sizeof(wchar_t) + do_commands.size_bytes() + undo_commands.size_bytes() + HistoryBody::size_bytes(branches);
+}
+
+inline auto HistoryBody::size_bytes(const Branches& branches) -> size_t
 {
-	ur_->create_action(name, merge_mode);
+	size_t out{};
+
+	for (const auto& branch : branches)
+	{
+		out += branch->bytes;
+	}
+
+	return out;
 }
 
-inline auto HistoryBody::commit_action() -> void
+inline HistoryBody::HistoryBody(HistoryCallbacks callbacks, int64_t length, size_t max_bytes)
+	: callbacks_{callbacks}
+	, length_{length}
+	, max_bytes_{max_bytes}
 {
-	front_ = get_version();
-	callbacks_.pre_commit(get_version());
+}
+
+inline auto HistoryBody::commit_action(godot::String name, godot_int object_id, int64_t merge_mode, CommandList do_commands, CommandList undo_commands, std::vector<uint8_t> payload) -> void
+{
+	if (branching_ && has_redo())
+	{
+		current_branches().push_back(detach_redo());
+	}
+	else
+	{
+		discard_redo();
+	}
+
+	const auto started { clock::now() };
+	const auto commands { do_commands.size() + undo_commands.size() };
+	const auto bytes { do_commands.size_bytes() + undo_commands.size_bytes() };
+
+	auto callback_time { measure([this] { callbacks_.pre_commit(get_version()); }) };
+
+	const auto now { clock::now() };
+
+	merge_mode = get_merge_mode(name, object_id, merge_mode, now);
+
+	if (merge_mode != godot::UndoRedo::MERGE_DISABLE)
+	{
+		auto& entry { entries_.back() };
+
+		bytes_ -= entry.size_bytes();
+
+		if (merge_mode == godot::UndoRedo::MERGE_ENDS)
+		{
+			entry.do_commands = std::move(do_commands);
+		}
+		else
+		{
+			entry.do_commands.append(std::move(do_commands));
+			entry.undo_commands.append(std::move(undo_commands));
+		}
+
+		entry.last_tick = now;
+		bytes_ += entry.size_bytes();
+		coalesced_actions_++;
+		// Only the stack position steps back; the version still advances,
+		// as with godot::UndoRedo, so a merged edit after a save is seen
+		current_--;
+	}
+	else
+	{
+		entries_.push_back({ name, object_id, std::move(do_commands), std::move(undo_commands), now, {} });
+		bytes_ += entries_.back().size_bytes();
+	}
+
 	committing_ = true;
-	ur_->commit_action();
+	redo_entry();
 	committing_ = false;
-	callbacks_.post_commit(get_version());
+	evict();
+	record(HistoryRecord::Type::commit, merge_mode, name, std::move(payload));
+	callback_time += measure([this] { callbacks_.post_commit(get_version()); });
+
+	if (instrumented_)
+	{
+		auto& stats { stats_[name] };
+
+		stats.commit.add(clock::now() - started);
+		stats.callbacks.add(callback_time);
+		stats.commands += commands;
+		stats.bytes += bytes;
+	}
 }
 
 inline auto HistoryBody::clear() -> void
 {
-	ur_->clear_history(false);
+	entries_.clear();
+	root_branches_.clear();
+	current_ = -1;
+	bytes_ = 0;
+	record(HistoryRecord::Type::clear);
 }
 
 inline auto HistoryBody::has_redo() const -> bool
 {
-	return ur_->has_redo();
+	return current_ + 1 < int64_t(entries_.size());
 }
 
 inline auto HistoryBody::has_undo() const -> bool
 {
-	return ur_->has_undo();
+	return current_ >= 0;
 }
 
 inline auto HistoryBody::is_committing() const -> bool
@@ -226,25 +852,122 @@ inline auto HistoryBody::is_committing() const -> bool
 
 inline auto HistoryBody::get_current_action_name() const -> godot::String
 {
-	return ur_->get_current_action_name();
+	if (current_ < 0) return {};
+
+	return entries_[current_].name;
 }
 
 inline auto HistoryBody::get_version() const -> int64_t
 {
-	return ur_->get_version();
+	return version_;
+}
+
+inline auto HistoryBody::get_usage() const -> HistoryUsage
+{
+	return { entries_.size(), bytes_, evicted_actions_, evicted_bytes_, coalesced_actions_ };
+}
+
+inline auto HistoryBody::set_coalesce_window(std::chrono::milliseconds window) -> void
+{
+	coalesce_window_ = window;
+}
+
+inline auto HistoryBody::set_recorder(HistoryRecorder recorder) -> void
+{
+	recorder_ = std::move(recorder);
+}
+
+inline auto HistoryBody::set_forced_merge_mode(std::optional<int64_t> merge_mode) -> void
+{
+	forced_merge_mode_ = merge_mode;
+}
+
+inline auto HistoryBody::set_instrumented(bool yes) -> void
+{
+	instrumented_ = yes;
+}
+
+inline auto HistoryBody::get_stats() const -> const std::map<godot::String, HistoryActionStats>&
+{
+	return stats_;
+}
+
+inline auto HistoryBody::reset_stats() -> void
+{
+	stats_.clear();
+}
+
+inline auto HistoryBody::set_branching(bool yes) -> void
+{
+	branching_ = yes;
+}
+
+inline auto HistoryBody::get_branch_count() const -> int64_t
+{
+	return current_branches().size();
+}
+
+inline auto HistoryBody::get_branch_name(int64_t index) const -> godot::String
+{
+	const auto& branches { current_branches() };
+
+	assert (index >= 0 && index < int64_t(branches.size()));
+
+	return branches[index]->entries.front().name;
+}
+
+// Makes an alternative branch the one redo() follows from here. The
+// previous redo path takes its place in the list of alternatives. Only the
+// two redo paths are moved; the shared prefix is left alone.
+inline auto HistoryBody::switch_branch(int64_t index) -> bool
+{
+	auto& branches { current_branches() };
+
+	if (index < 0 || index >= int64_t(branches.size())) return false;
+
+	auto chosen { std::move(branches[index]) };
+
+	if (has_redo())
+	{
+		branches[index] = detach_redo();
+	}
+	else
+	{
+		branches.erase(branches.begin() + index);
+	}
+
+	entries_.insert(entries_.end(), std::make_move_iterator(chosen->entries.begin()), std::make_move_iterator(chosen->entries.end()));
+
+	if (recorder_)
+	{
+		recorder_({ HistoryRecord::Type::branch, get_version(), 0, {}, {}, index });
+	}
+
+	return true;
 }
 
 inline auto HistoryBody::redo() -> bool
 {
-	callbacks_.pre_redo(get_version());
+	const auto started { clock::now() };
+
+	auto callback_time { measure([this] { callbacks_.pre_redo(get_version()); }) };
 
-	const auto result { ur_->redo() };
+	const auto result { redo_entry() };
 
-	callbacks_.post_redo(get_version());
+	callback_time += measure([this] { callbacks_.post_redo(get_version()); });
 
 	if (result)
 	{
-		callbacks_.post_action_redo(get_current_action_name());
+		record(HistoryRecord::Type::redo);
+		callback_time += measure([this] { callbacks_.post_action_redo(get_current_action_name()); });
+
+		if (instrumented_)
+		{
+			auto& stats { stats_[get_current_action_name()] };
+
+			stats.redo.add(clock::now() - started);
+			stats.callbacks.add(callback_time);
+		}
 
 		return true;
 	}
@@ -254,22 +977,27 @@ inline auto HistoryBody::redo() -> bool
 
 inline auto HistoryBody::undo() -> bool
 {
-	if (get_version() <= front_ - length_)
-	{
-		return false;
-	}
-
+	const auto started { clock::now() };
 	const auto current_action_name = get_current_action_name();
 
-	callbacks_.pre_undo(get_version());
+	auto callback_time { measure([this] { callbacks_.pre_undo(get_version()); }) };
 
-	const auto result { ur_->undo() };
+	const auto result { undo_entry() };
 
-	callbacks_.post_undo(get_version());
+	callback_time += measure([this] { callbacks_.post_undo(get_version()); });
 
 	if (result)
 	{
-		callbacks_.post_action_undo(current_action_name);
+		record(HistoryRecord::Type::undo);
+		callback_time += measure([this, &current_action_name] { callbacks_.post_action_undo(current_action_name); });
+
+		if (instrumented_)
+		{
+			auto& stats { stats_[current_action_name] };
+
+			stats.undo.add(clock::now() - started);
+			stats.callbacks.add(callback_time);
+		}
 
 		return true;
 	}
@@ -277,11 +1005,152 @@ inline auto HistoryBody::undo() -> bool
 	return false;
 }
 
+inline auto HistoryBody::redo_entry() -> bool
+{
+	if (!has_redo()) return false;
+
+	current_++;
+	entries_[current_].do_commands.run();
+	version_++;
+
+	return true;
+}
+
+inline auto HistoryBody::undo_entry() -> bool
+{
+	if (!has_undo()) return false;
+
+	entries_[current_].undo_commands.run();
+	current_--;
+	version_--;
+
+	return true;
+}
+
+// Returns the merge mode to actually commit with: MERGE_DISABLE if the
+// action can't merge with the last one, MERGE_ENDS if it is being
+// coalesced automatically, otherwise the requested mode.
+inline auto HistoryBody::get_merge_mode(const godot::String& name, godot_int object_id, int64_t merge_mode, clock::time_point now) const -> int64_t
+{
+	if (entries_.empty()) return godot::UndoRedo::MERGE_DISABLE;
+	if (forced_merge_mode_) return *forced_merge_mode_;
+
+	const auto& last { entries_.back() };
+
+	// Other branches continue from the state this action leaves behind
+	if (!last.branches.empty()) return godot::UndoRedo::MERGE_DISABLE;
+
+	if (last.name != name) return godot::UndoRedo::MERGE_DISABLE;
+
+	if (merge_mode != godot::UndoRedo::MERGE_DISABLE)
+	{
+		if (last.last_tick + MERGE_WINDOW > now) return merge_mode;
+
+		return godot::UndoRedo::MERGE_DISABLE;
+	}
+
+	if (coalesce_window_.count() > 0 && last.object_id == object_id && last.last_tick + coalesce_window_ > now)
+	{
+		return godot::UndoRedo::MERGE_ENDS;
+	}
+
+	return godot::UndoRedo::MERGE_DISABLE;
+}
+
+template <typename Fn>
+auto HistoryBody::measure(Fn&& fn) -> clock::duration
+{
+	if (!instrumented_)
+	{
+		fn();
+		return {};
+	}
+
+	const auto started { clock::now() };
+
+	fn();
+
+	return clock::now() - started;
+}
+
+inline auto HistoryBody::record(HistoryRecord::Type type, int64_t merge_mode, godot::String name, std::vector<uint8_t> payload) -> void
+{
+	if (!recorder_) return;
+
+	recorder_({ type, get_version(), merge_mode, to_std_string(name), std::move(payload) });
+}
+
+inline auto HistoryBody::current_branches() -> Branches&
+{
+	return current_ < 0 ? root_branches_ : entries_[current_].branches;
+}
+
+inline auto HistoryBody::current_branches() const -> const Branches&
+{
+	return current_ < 0 ? root_branches_ : entries_[current_].branches;
+}
+
+// Moves the redo path out into a branch. Its bytes stay accounted for.
+inline auto HistoryBody::detach_redo() -> std::unique_ptr<Branch>
+{
+	auto branch { std::make_unique<Branch>() };
+
+	const auto begin { entries_.begin() + (current_ + 1) };
+
+	for (auto entry { begin }; entry != entries_.end(); entry++)
+	{
+		branch->bytes += entry->size_bytes();
+	}
+
+	branch->entries.insert(branch->entries.end(), std::make_move_iterator(begin), std::make_move_iterator(entries_.end()));
+	entries_.erase(begin, entries_.end());
+
+	return branch;
+}
+
+inline auto HistoryBody::discard_redo() -> void
+{
+	while (has_redo())
+	{
+		bytes_ -= entries_.back().size_bytes();
+		entries_.pop_back();
+	}
+}
+
+// Drops the oldest actions until the history is back within its limits.
+// The most recent action is always kept, however large it is.
+inline auto HistoryBody::evict() -> void
+{
+	const auto over_budget = [this]
+	{
+		if (length_ > 0 && int64_t(entries_.size()) > length_) return true;
+		if (max_bytes_ > 0 && bytes_ > max_bytes_) return true;
+
+		return false;
+	};
+
+	while (entries_.size() > 1 && current_ > 0 && over_budget())
+	{
+		auto& front { entries_.front() };
+
+		// Branches off the dropped action now start from the oldest
+		// reachable state; anything branching off before it is gone
+		const auto size { front.size_bytes() - size_bytes(front.branches) + size_bytes(root_branches_) };
+
+		root_branches_ = std::move(front.branches);
+		entries_.pop_front();
+		current_--;
+		bytes_ -= size;
+		evicted_actions_++;
+		evicted_bytes_ += size;
+	}
+}
+
 } // detail
 
 // +++ History +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-inline History::History(HistoryCallbacks callbacks, int64_t length)
-	: body_{ std::make_unique<detail::HistoryBody>(callbacks, length) }
+inline History::History(HistoryCallbacks callbacks, int64_t length, size_t max_bytes)
+	: body_{ std::make_unique<detail::HistoryBody>(callbacks, length, max_bytes) }
 {
 }
 
@@ -335,6 +1204,126 @@ inline auto History::get_version() const -> int64_t
 	return body_->get_version();
 }
 
+inline auto History::get_usage() const -> HistoryUsage
+{
+	return body_->get_usage();
+}
+
+inline auto History::set_coalesce_window(std::chrono::milliseconds window) -> void
+{
+	body_->set_coalesce_window(window);
+}
+
+inline auto History::set_recorder(HistoryRecorder recorder) -> void
+{
+	body_->set_recorder(std::move(recorder));
+}
+
+template <typename Rebuild>
+auto History::replay(const HistoryRecord& record, Rebuild&& rebuild) -> void
+{
+	switch (record.type)
+	{
+		case HistoryRecord::Type::commit:
+		{
+			body_->set_forced_merge_mode(record.merge_mode);
+			rebuild(record);
+			body_->set_forced_merge_mode(std::nullopt);
+			return;
+		}
+
+		case HistoryRecord::Type::undo:
+		{
+			undo();
+			return;
+		}
+
+		case HistoryRecord::Type::redo:
+		{
+			redo();
+			return;
+		}
+
+		case HistoryRecord::Type::clear:
+		{
+			clear();
+			return;
+		}
+
+		case HistoryRecord::Type::branch:
+		{
+			switch_branch(record.branch);
+			return;
+		}
+	}
+}
+
+inline auto History::set_instrumented(bool yes) -> void
+{
+	body_->set_instrumented(yes);
+}
+
+inline auto History::get_stats() const -> const std::map<godot::String, HistoryActionStats>&
+{
+	return body_->get_stats();
+}
+
+// { action name: { commits, undos, redos, commands, bytes, commit_usec,
+// commit_max_usec, undo_usec, undo_max_usec, redo_usec, redo_max_usec,
+// callback_usec, callback_max_usec } }
+inline auto History::get_stats_report() const -> godot::Dictionary
+{
+	godot::Dictionary out;
+
+	for (const auto& [name, stats] : get_stats())
+	{
+		godot::Dictionary item;
+
+		item["commits"] = int64_t(stats.commit.count);
+		item["undos"] = int64_t(stats.undo.count);
+		item["redos"] = int64_t(stats.redo.count);
+		item["commands"] = int64_t(stats.commands);
+		item["bytes"] = int64_t(stats.bytes);
+		item["commit_usec"] = int64_t(stats.commit.total.count());
+		item["commit_max_usec"] = int64_t(stats.commit.max.count());
+		item["undo_usec"] = int64_t(stats.undo.total.count());
+		item["undo_max_usec"] = int64_t(stats.undo.max.count());
+		item["redo_usec"] = int64_t(stats.redo.total.count());
+		item["redo_max_usec"] = int64_t(stats.redo.max.count());
+		item["callback_usec"] = int64_t(stats.callbacks.total.count());
+		item["callback_max_usec"] = int64_t(stats.callbacks.max.count());
+
+		out[name] = item;
+	}
+
+	return out;
+}
+
+inline auto History::reset_stats() -> void
+{
+	body_->reset_stats();
+}
+
+inline auto History::set_branching(bool yes) -> void
+{
+	body_->set_branching(yes);
+}
+
+inline auto History::get_branch_count() const -> int64_t
+{
+	return body_->get_branch_count();
+}
+
+inline auto History::get_branch_name(int64_t index) const -> godot::String
+{
+	return body_->get_branch_name(index);
+}
+
+inline auto History::switch_branch(int64_t index) -> bool
+{
+	return body_->switch_branch(index);
+}
+
 inline auto History::redo() -> bool
 {
 	return body_->redo();
@@ -346,105 +1335,131 @@ inline auto History::undo() -> bool
 }
 
 // +++ Action ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-inline Action::Action(detail::HistoryBody* body, godot::String name, int64_t merge_mode)
+inline Action::Action(detail::HistoryBody* body, godot::String name, int64_t merge_mode, godot_int object_id)
 	: body_{body}
-	, name_{name}
+	, name_{std::move(name)}
+	, object_id_{object_id}
 	, merge_mode_{merge_mode}
 {
 }
 
 template <typename ... Args>
-auto Action::add_do(godot::Object* object, godot::String method, Args... args) -> void
+auto Action::add_do(godot::Object* object, godot::String method, Args&&... args) -> void
 {
 	assert (body_);
-	add_do(object, method, godot::Array::make(args...));
+	add_do(object, std::move(method), detail::make_args(std::forward<Args>(args)...));
 }
 
 template <typename ... Args>
-auto Action::add_undo(godot::Object* object, godot::String method, Args... args) -> void
+auto Action::add_undo(godot::Object* object, godot::String method, Args&&... args) -> void
+{
+	assert (body_);
+	add_undo(object, std::move(method), detail::make_args(std::forward<Args>(args)...));
+}
+
+template <typename Fn> requires std::invocable<Fn&>
+auto Action::add_do(Fn&& fn) -> void
 {
 	assert (body_);
-	add_undo(object, method, godot::Array::make(args...));
+	do_.push(std::forward<Fn>(fn));
+}
+
+template <typename Fn> requires std::invocable<Fn&>
+auto Action::add_undo(Fn&& fn) -> void
+{
+	assert (body_);
+	undo_.push(std::forward<Fn>(fn));
+}
+
+template <typename T, typename DoFn, typename UndoFn>
+auto Action::add_bulk(std::vector<T> items, DoFn do_fn, UndoFn undo_fn) -> void
+{
+	assert (body_);
+
+	const auto bytes { items.capacity() * sizeof(T) };
+	const auto shared_items { std::make_shared<const std::vector<T>>(std::move(items)) };
+
+	do_.push(detail::BulkCall<T, DoFn, false>{ shared_items, std::move(do_fn), bytes });
+	undo_.push(detail::BulkCall<T, UndoFn, true>{ shared_items, std::move(undo_fn), 0 });
 }
 
 inline auto Action::add_do(godot::Object* object, godot::String method, godot::Array args) -> void
 {
 	assert (body_);
-	commands_.push_back(Redo{ object, method, args});
+	do_.push(detail::MethodCall{ object, std::move(method), std::move(args) });
 }
 
 inline auto Action::add_undo(godot::Object* object, godot::String method, godot::Array args) -> void
 {
 	assert (body_);
-	commands_.push_back(Undo{ object, method, args});
+	undo_.push(detail::MethodCall{ object, std::move(method), std::move(args) });
 }
 
 inline auto Action::clear() -> void
 {
 	assert (body_);
-	commands_.clear();
+	do_.clear();
+	undo_.clear();
 }
 
 inline auto Action::commit() -> void
 {
 	assert (body_);
+	body_->commit_action(std::move(name_), object_id_, merge_mode_, std::move(do_), std::move(undo_), std::move(payload_));
 
-	struct visitor
-	{
-		detail::HistoryBody* body;
-
-		auto operator()(Redo redo) -> void
-		{
-			body->add_do(redo.object, redo.method, redo.args);
-		};
-
-		auto operator()(Undo undo) -> void
-		{
-			body->add_undo(undo.object, undo.method, undo.args);
-		};
-	};
+	// Spent; reusing it trips the asserts instead of committing an empty action
+	body_ = nullptr;
+}
 
-	body_->create_action(name_, merge_mode_);
+inline auto Action::is_committed() const -> bool
+{
+	return !body_;
+}
 
-	for (auto command : commands_)
-	{
-		std::visit(visitor{body_}, command);
-	}
+inline auto Action::reserve(size_t commands) -> void
+{
+	assert (body_);
+	do_.reserve<detail::MethodCall>(commands);
+	undo_.reserve<detail::MethodCall>(commands);
+}
 
-	body_->commit_action();
+inline auto Action::set_payload(std::vector<uint8_t> payload) -> void
+{
+	assert (body_);
+	payload_ = std::move(payload);
 }
 
 // +++ ObjectAction ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 inline ObjectAction::ObjectAction(detail::HistoryBody* body, godot::Object* object, godot::String name, int64_t merge_mode)
-	: Action{body, name, merge_mode}
+	: Action{body, name, merge_mode, object ? object->get_instance_id() : 0}
 	, object_{object}
 {
 }
 
 template <typename ... Args>
-auto ObjectAction::add_do(godot::String method, Args... args) -> void
+auto ObjectAction::add_do(godot::String method, Args&&... args) -> void
 {
 	assert (object_);
-	Action::add_do(object_, method, args...);
+	Action::add_do(object_, std::move(method), std::forward<Args>(args)...);
 }
 
 template <typename ... Args>
-auto ObjectAction::add_undo(godot::String method, Args... args) -> void
+auto ObjectAction::add_undo(godot::String method, Args&&... args) -> void
 {
 	assert (object_);
-	Action::add_undo(object_, method, args...);
+	Action::add_undo(object_, std::move(method), std::forward<Args>(args)...);
 }
 
 inline auto ObjectAction::add_do(godot::String method, godot::Array args) -> void
 {
 	assert (object_);
-	Action::add_do(object_, method, args);
+	Action::add_do(object_, std::move(method), std::move(args));
 }
 
 inline auto ObjectAction::add_undo(godot::String method, godot::Array args) -> void
 {
 	assert (object_);
-	Action::add_undo(object_, method, args);
+	Action::add_undo(object_, std::move(method), std::move(args));
 }
 
 // +++ ScopedAction ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
@@ -470,7 +1485,7 @@ inline auto ScopedAction::operator=(ScopedAction && rhs) noexcept -> ScopedActio
 
 inline ScopedAction::~ScopedAction()
 {
-	if (dead_) return;
+	if (dead_ || is_committed()) return;
 
 	commit();
 }
@@ -498,7 +1513,7 @@ inline auto ScopedObjectAction::operator=(ScopedObjectAction && rhs) noexcept ->
 
 inline ScopedObjectAction::~ScopedObjectAction()
 {
-	if (dead_) return;
+	if (dead_ || is_committed()) return;
 
 	commit();
 }
@@ -0,0 +1,412 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "history.hpp"
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace gdn {
+
+struct HistoryJournalOptions
+{
+	std::chrono::milliseconds sync_interval{1000};
+};
+
+// Append-only binary log of History changes, for crash recovery.
+//
+// Records are encoded and written on a background thread; fsync is batched
+// to at most once per sync_interval (and on flush() / destruction). After a
+// crash, read() returns every record that made it to disk intact, which can
+// be fed back through History::replay() before attaching a new journal.
+// Opening an existing journal first cuts off anything after its last intact
+// record, so that records appended after recovery can be read back too.
+//
+// File layout: "GDNJ", u32 format version, then for each record:
+// u32 body size, u32 FNV-1a checksum of the body, and the body itself:
+// u8 type, u8 merge mode, i64 version, u32 branch, u32 name size,
+// name (utf8), payload.
+class HistoryJournal
+{
+public:
+
+	using Options = HistoryJournalOptions;
+
+	HistoryJournal(std::filesystem::path path, Options options = {});
+	HistoryJournal(const HistoryJournal&) = delete;
+	auto operator=(const HistoryJournal&) -> HistoryJournal& = delete;
+	~HistoryJournal();
+
+	auto append(HistoryRecord record) -> void;
+	auto flush() -> void;
+	auto reset(History* history) -> void;
+	auto is_ok() const -> bool;
+	auto recorder() -> HistoryRecorder;
+
+	static auto read(const std::filesystem::path& path) -> std::vector<HistoryRecord>;
+
+private:
+
+	static constexpr char MAGIC[4] { 'G', 'D', 'N', 'J' };
+	static constexpr uint32_t FORMAT_VERSION { 1 };
+	static constexpr uint32_t HEADER_SIZE { 18 };
+
+	using clock = std::chrono::steady_clock;
+
+	static auto checksum(const char* data, size_t size) -> uint32_t;
+	static auto scan(const std::vector<char>& data, std::vector<HistoryRecord>* out) -> size_t;
+	static auto encode(const HistoryRecord& record, std::vector<char>* out) -> void;
+
+	auto open(bool truncate) -> void;
+	auto sync() -> void;
+	auto run() -> void;
+
+	std::filesystem::path path_;
+	Options options_;
+	std::FILE* file_{};
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::condition_variable synced_;
+	std::vector<HistoryRecord> queue_;
+	uint64_t appended_{};
+	uint64_t synced_count_{};
+	bool flush_requested_{false};
+	bool reset_requested_{false};
+	bool stop_{false};
+	std::atomic<bool> ok_{true};
+	std::thread thread_;
+};
+
+inline HistoryJournal::HistoryJournal(std::filesystem::path path, Options options)
+	: path_{std::move(path)}
+	, options_{options}
+{
+	open(false);
+
+	thread_ = std::thread{[this] { run(); }};
+}
+
+inline HistoryJournal::~HistoryJournal()
+{
+	{
+		std::lock_guard lock{mutex_};
+		stop_ = true;
+	}
+
+	wake_.notify_one();
+	thread_.join();
+
+	if (file_) std::fclose(file_);
+}
+
+inline auto HistoryJournal::append(HistoryRecord record) -> void
+{
+	{
+		std::lock_guard lock{mutex_};
+		queue_.push_back(std::move(record));
+		appended_++;
+	}
+
+	wake_.notify_one();
+}
+
+// Blocks until everything appended so far is on disk
+inline auto HistoryJournal::flush() -> void
+{
+	std::unique_lock lock{mutex_};
+
+	const auto target { appended_ };
+
+	flush_requested_ = true;
+	wake_.notify_one();
+	synced_.wait(lock, [this, target] { return synced_count_ >= target || !ok_; });
+}
+
+// Discards the journal once the document has been saved. Replaying starts
+// from the saved document with nothing to undo, so the history is cleared
+// too; otherwise undoing past the save would be journaled but do nothing
+// on replay, and the recovered document would differ from the live one.
+inline auto HistoryJournal::reset(History* history) -> void
+{
+	history->clear();
+
+	{
+		std::lock_guard lock{mutex_};
+		queue_.clear();
+		reset_requested_ = true;
+	}
+
+	wake_.notify_one();
+}
+
+inline auto HistoryJournal::is_ok() const -> bool
+{
+	return ok_;
+}
+
+inline auto HistoryJournal::recorder() -> HistoryRecorder
+{
+	return [this](HistoryRecord record) { append(std::move(record)); };
+}
+
+// Returns the intact records, stopping at the first torn or corrupt one
+inline auto HistoryJournal::read(const std::filesystem::path& path) -> std::vector<HistoryRecord>
+{
+	std::vector<HistoryRecord> out;
+	std::ifstream file{path, std::ios::binary};
+
+	if (!file) return out;
+
+	const std::vector<char> data{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+
+	scan(data, &out);
+
+	return out;
+}
+
+inline auto HistoryJournal::checksum(const char* data, size_t size) -> uint32_t
+{
+	uint32_t hash { 2166136261u };
+
+	for (size_t i = 0; i < size; i++)
+	{
+		hash = (hash ^ uint8_t(data[i])) * 16777619u;
+	}
+
+	return hash;
+}
+
+// Decodes records into out, if given, and returns the size of the intact
+// part of the file, or zero if the header isn't valid
+inline auto HistoryJournal::scan(const std::vector<char>& data, std::vector<HistoryRecord>* out) -> size_t
+{
+	const auto read_u32 = [&data](size_t at)
+	{
+		uint32_t value;
+		std::memcpy(&value, data.data() + at, sizeof(value));
+		return value;
+	};
+
+	if (data.size() < 8 || std::memcmp(data.data(), MAGIC, 4) != 0 || read_u32(4) != FORMAT_VERSION)
+	{
+		return 0;
+	}
+
+	size_t at { 8 };
+
+	while (at + 8 <= data.size())
+	{
+		const auto size { read_u32(at) };
+		const auto body { at + 8 };
+
+		if (size < HEADER_SIZE || body + size > data.size()) break;
+		if (checksum(data.data() + body, size) != read_u32(at + 4)) break;
+
+		HistoryRecord record;
+		int64_t version;
+		uint32_t branch;
+		uint32_t name_size;
+
+		record.type = HistoryRecord::Type(uint8_t(data[body]));
+		record.merge_mode = uint8_t(data[body + 1]);
+		std::memcpy(&version, data.data() + body + 2, sizeof(version));
+		std::memcpy(&branch, data.data() + body + 10, sizeof(branch));
+		std::memcpy(&name_size, data.data() + body + 14, sizeof(name_size));
+		record.version = version;
+		record.branch = branch;
+
+		if (HEADER_SIZE + size_t(name_size) > size) break;
+
+		if (out)
+		{
+			const auto name { data.data() + body + HEADER_SIZE };
+			const auto payload { name + name_size };
+
+			record.name.assign(name, name_size);
+			record.payload.assign(payload, data.data() + body + size);
+			out->push_back(std::move(record));
+		}
+
+		at = body + size;
+	}
+
+	return at;
+}
+
+inline auto HistoryJournal::encode(const HistoryRecord& record, std::vector<char>* out) -> void
+{
+	const auto name_size { uint32_t(record.name.size()) };
+	const auto size { uint32_t(HEADER_SIZE + record.name.size() + record.payload.size()) };
+	const auto type { char(record.type) };
+	const auto merge_mode { char(record.merge_mode) };
+	const auto version { int64_t(record.version) };
+	const auto branch { uint32_t(record.branch) };
+	const auto start { out->size() };
+
+	const auto write = [out](const void* data, size_t bytes)
+	{
+		if (bytes == 0) return;
+
+		const auto at { out->size() };
+		out->resize(at + bytes);
+		std::memcpy(out->data() + at, data, bytes);
+	};
+
+	out->reserve(start + 8 + size);
+
+	write(&size, sizeof(size));
+	write(&size, sizeof(size)); // checksum, filled in below
+	write(&type, 1);
+	write(&merge_mode, 1);
+	write(&version, sizeof(version));
+	write(&branch, sizeof(branch));
+	write(&name_size, sizeof(name_size));
+	write(record.name.data(), record.name.size());
+	write(record.payload.data(), record.payload.size());
+
+	const auto sum { checksum(out->data() + start + 8, size) };
+
+	std::memcpy(out->data() + start + 4, &sum, sizeof(sum));
+}
+
+inline auto HistoryJournal::open(bool truncate) -> void
+{
+	if (file_) std::fclose(std::exchange(file_, nullptr));
+
+	auto fresh { truncate || !std::filesystem::exists(path_) };
+
+	if (!fresh)
+	{
+		std::vector<char> data;
+
+		{
+			std::ifstream file{path_, std::ios::binary};
+
+			data.assign(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
+		}
+
+		const auto intact { scan(data, nullptr) };
+
+		// Records appended after a torn one could never be read back
+		if (intact == 0) fresh = true;
+		else if (intact < data.size()) std::filesystem::resize_file(path_, intact);
+	}
+
+	file_ = std::fopen(path_.string().c_str(), fresh ? "wb" : "ab");
+
+	if (!file_)
+	{
+		throw std::runtime_error("Couldn't open history journal: " + path_.string());
+	}
+
+	if (fresh)
+	{
+		std::fwrite(MAGIC, 1, sizeof(MAGIC), file_);
+		std::fwrite(&FORMAT_VERSION, sizeof(FORMAT_VERSION), 1, file_);
+		std::fflush(file_);
+	}
+}
+
+inline auto HistoryJournal::sync() -> void
+{
+	std::fflush(file_);
+#if defined(_WIN32)
+	_commit(_fileno(file_));
+#else
+	fsync(fileno(file_));
+#endif
+}
+
+inline auto HistoryJournal::run() -> void
+{
+	std::vector<HistoryRecord> records;
+	std::vector<char> buffer;
+	auto last_sync { clock::now() };
+	auto dirty { false };
+
+	std::unique_lock lock{mutex_};
+
+	for (;;)
+	{
+		wake_.wait_for(lock, options_.sync_interval, [this] { return stop_ || flush_requested_ || reset_requested_ || !queue_.empty(); });
+
+		std::swap(records, queue_);
+
+		const auto reset { std::exchange(reset_requested_, false) };
+		const auto force_sync { std::exchange(flush_requested_, false) || stop_ };
+		const auto stopping { stop_ };
+		const auto target { appended_ };
+
+		lock.unlock();
+
+		auto ok { true };
+
+		try
+		{
+			if (reset)
+			{
+				open(true);
+			}
+
+			buffer.clear();
+
+			for (const auto& record : records)
+			{
+				encode(record, &buffer);
+			}
+
+			records.clear();
+
+			if (!file_)
+			{
+				ok = false;
+			}
+			else if (!buffer.empty())
+			{
+				ok = std::fwrite(buffer.data(), 1, buffer.size(), file_) == buffer.size();
+				dirty = true;
+			}
+
+			if (file_ && dirty && (force_sync || clock::now() - last_sync >= options_.sync_interval))
+			{
+				sync();
+				dirty = false;
+				last_sync = clock::now();
+			}
+		}
+		catch (const std::exception&)
+		{
+			ok = false;
+		}
+
+		lock.lock();
+
+		ok_ = ok_ && ok;
+
+		if (!dirty)
+		{
+			synced_count_ = std::max(synced_count_, target);
+			synced_.notify_all();
+		}
+
+		if (stopping && queue_.empty()) return;
+	}
+}
+
+} // gdn
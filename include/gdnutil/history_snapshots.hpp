@@ -0,0 +1,434 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <Array.hpp>
+#include <Dictionary.hpp>
+#include "history.hpp"
+
+namespace gdn {
+namespace delta {
+
+// Structural deltas between two encoded documents, in the same
+// Dictionary/Array shapes the encoders produce:
+//
+//   { "set": { key: value }, "erase": [ key ], "patch": { key: delta } }
+//
+// Nested dictionaries, and arrays whose length didn't change, are patched
+// rather than replaced, so a delta is proportional to what changed. An
+// empty Dictionary means no change.
+
+inline constexpr auto SET { "set" };
+inline constexpr auto ERASE { "erase" };
+inline constexpr auto PATCH { "patch" };
+
+inline auto diff(godot::Dictionary from, godot::Dictionary to) -> godot::Dictionary;
+inline auto diff(godot::Array from, godot::Array to) -> godot::Dictionary;
+
+namespace detail {
+
+inline auto copy(const godot::Variant& value) -> godot::Variant
+{
+	switch (value.get_type())
+	{
+		case godot::Variant::DICTIONARY: return godot::Dictionary(value).duplicate(true);
+		case godot::Variant::ARRAY: return godot::Array(value).duplicate(true);
+		default: return value;
+	}
+}
+
+inline auto get_or_make(godot::Dictionary* delta, const char* section) -> godot::Dictionary
+{
+	if (!delta->has(section))
+	{
+		(*delta)[section] = godot::Dictionary{};
+	}
+
+	return (*delta)[section];
+}
+
+inline auto diff_value(godot::Variant key, const godot::Variant& from, const godot::Variant& to, godot::Dictionary* delta) -> void
+{
+	// Cheap for shared subtrees, which Godot compares by identity
+	if (from.get_type() == to.get_type() && from == to) return;
+
+	auto patch { godot::Dictionary{} };
+
+	if (from.get_type() == godot::Variant::DICTIONARY && to.get_type() == godot::Variant::DICTIONARY)
+	{
+		patch = diff(godot::Dictionary(from), godot::Dictionary(to));
+	}
+	else if (from.get_type() == godot::Variant::ARRAY && to.get_type() == godot::Variant::ARRAY && godot::Array(from).size() == godot::Array(to).size())
+	{
+		patch = diff(godot::Array(from), godot::Array(to));
+	}
+	else
+	{
+		get_or_make(delta, SET)[key] = copy(to);
+		return;
+	}
+
+	if (!patch.empty())
+	{
+		get_or_make(delta, PATCH)[key] = patch;
+	}
+}
+
+inline auto slot(godot::Dictionary* target, const godot::Variant& key) -> godot::Variant&
+{
+	return (*target)[key];
+}
+
+inline auto slot(godot::Array* target, const godot::Variant& key) -> godot::Variant&
+{
+	return (*target)[int64_t(key)];
+}
+
+} // detail
+
+inline auto diff(godot::Dictionary from, godot::Dictionary to) -> godot::Dictionary
+{
+	godot::Dictionary out;
+
+	const auto from_keys { from.keys() };
+	const auto to_keys { to.keys() };
+
+	godot::Array erased;
+
+	for (int i = 0; i < from_keys.size(); i++)
+	{
+		if (!to.has(from_keys[i]))
+		{
+			erased.append(from_keys[i]);
+		}
+	}
+
+	if (!erased.empty())
+	{
+		out[ERASE] = erased;
+	}
+
+	for (int i = 0; i < to_keys.size(); i++)
+	{
+		const auto key { to_keys[i] };
+
+		if (from.has(key))
+		{
+			detail::diff_value(key, from[key], to[key], &out);
+		}
+		else
+		{
+			detail::get_or_make(&out, SET)[key] = detail::copy(to[key]);
+		}
+	}
+
+	return out;
+}
+
+// Arrays must be the same length; callers replace them wholesale otherwise
+inline auto diff(godot::Array from, godot::Array to) -> godot::Dictionary
+{
+	assert (from.size() == to.size());
+
+	godot::Dictionary out;
+
+	for (int i = 0; i < to.size(); i++)
+	{
+		detail::diff_value(i, from[i], to[i], &out);
+	}
+
+	return out;
+}
+
+template <typename Container>
+auto apply(Container target, godot::Dictionary delta) -> void
+{
+	if constexpr (std::is_same_v<Container, godot::Dictionary>)
+	{
+		if (delta.has(ERASE))
+		{
+			const godot::Array erased { delta[ERASE] };
+
+			for (int i = 0; i < erased.size(); i++)
+			{
+				target.erase(erased[i]);
+			}
+		}
+	}
+
+	if (delta.has(SET))
+	{
+		const godot::Dictionary set { delta[SET] };
+		const auto keys { set.keys() };
+
+		for (int i = 0; i < keys.size(); i++)
+		{
+			detail::slot(&target, keys[i]) = detail::copy(set[keys[i]]);
+		}
+	}
+
+	if (delta.has(PATCH))
+	{
+		const godot::Dictionary patch { delta[PATCH] };
+		const auto keys { patch.keys() };
+
+		for (int i = 0; i < keys.size(); i++)
+		{
+			const auto value { detail::slot(&target, keys[i]) };
+
+			if (value.get_type() == godot::Variant::DICTIONARY)
+			{
+				apply(godot::Dictionary(value), godot::Dictionary(patch[keys[i]]));
+			}
+			else
+			{
+				assert (value.get_type() == godot::Variant::ARRAY);
+				apply(godot::Array(value), godot::Dictionary(patch[keys[i]]));
+			}
+		}
+	}
+}
+
+} // delta
+
+// Undo for edits that can't be expressed as cheap inverse calls, such as
+// bulk imports. Versions of the document are kept as a full snapshot every
+// snapshot_interval versions, plus forward and backward deltas between
+// neighbours. Undo/redo patch the live document in place; get() rebuilds
+// any version from its nearest snapshot.
+//
+// Documents handed to record() are treated as immutable, so they can share
+// unchanged subtrees with the live document. The history of versions is
+// linear, don't use this with History::set_branching().
+//
+// Each action's commands report the size of its deltas and snapshot to
+// History, so they count against its byte budget, and versions are
+// dropped once History drops the actions that lead to them. Versions back
+// to the nearest snapshot before the oldest reachable one are kept.
+class DocumentHistory
+{
+public:
+
+	using OnChanged = std::function<void(godot::Dictionary document)>;
+
+	DocumentHistory(godot::Dictionary document, OnChanged on_changed, int64_t snapshot_interval = 32);
+	DocumentHistory(const DocumentHistory&) = delete;
+	auto operator=(const DocumentHistory&) -> DocumentHistory& = delete;
+
+	auto get_document() const -> godot::Dictionary;
+	auto get_current_version() const -> int64_t;
+
+	// Versions that can still be reached by undo and redo run from the
+	// oldest up to get_version_count() - 1
+	auto get_oldest_version() const -> int64_t;
+	auto get_version_count() const -> int64_t;
+	auto get(int64_t version) const -> godot::Dictionary;
+
+	// Records next as the version following the current one and adds the
+	// commands to reach and leave it to action. Committing the action
+	// makes it current.
+	auto record(Action* action, godot::Dictionary next) -> void;
+
+private:
+
+	struct Version
+	{
+		godot::Dictionary forward;
+		godot::Dictionary backward;
+		godot::Dictionary snapshot;
+		uint64_t id;
+	};
+
+	// Shared by the do and undo commands of the action that leads to a
+	// version. Once History has destroyed both, the version is released.
+	struct Lease
+	{
+		std::weak_ptr<DocumentHistory*> owner;
+		int64_t version;
+		uint64_t id;
+
+		~Lease();
+	};
+
+	struct Step
+	{
+		std::shared_ptr<Lease> lease;
+		int64_t target;
+		size_t reported_bytes;
+
+		auto operator()() -> void;
+		auto approx_size() const -> size_t;
+	};
+
+	auto at(int64_t version) const -> const Version&;
+	auto release(int64_t version, uint64_t id) -> void;
+	auto seek(int64_t version) -> void;
+
+	godot::Dictionary document_;
+	OnChanged on_changed_;
+	int64_t snapshot_interval_;
+	int64_t current_{0};
+	int64_t first_{0};
+	int64_t oldest_{0};
+	uint64_t next_id_{0};
+	std::deque<Version> versions_;
+	std::shared_ptr<DocumentHistory*> self_;
+};
+
+inline DocumentHistory::DocumentHistory(godot::Dictionary document, OnChanged on_changed, int64_t snapshot_interval)
+	: document_{document.duplicate(true)}
+	, on_changed_{std::move(on_changed)}
+	, snapshot_interval_{snapshot_interval}
+	, self_{std::make_shared<DocumentHistory*>(this)}
+{
+	assert (snapshot_interval_ > 0);
+
+	versions_.push_back({ {}, {}, document_.duplicate(true), next_id_++ });
+}
+
+inline auto DocumentHistory::get_document() const -> godot::Dictionary
+{
+	return document_;
+}
+
+inline auto DocumentHistory::get_current_version() const -> int64_t
+{
+	return current_;
+}
+
+inline auto DocumentHistory::get_oldest_version() const -> int64_t
+{
+	return oldest_;
+}
+
+inline auto DocumentHistory::get_version_count() const -> int64_t
+{
+	return first_ + int64_t(versions_.size());
+}
+
+inline auto DocumentHistory::get(int64_t version) const -> godot::Dictionary
+{
+	assert (version >= first_ && version < get_version_count());
+
+	if (version == current_) return document_.duplicate(true);
+
+	auto base { version - version % snapshot_interval_ };
+	auto out { at(base).snapshot.duplicate(true) };
+
+	while (base < version)
+	{
+		delta::apply(out, at(++base).forward);
+	}
+
+	return out;
+}
+
+inline auto DocumentHistory::record(Action* action, godot::Dictionary next) -> void
+{
+	const auto version { current_ + 1 };
+
+	versions_.resize(size_t(version - first_));
+
+	Version entry{ delta::diff(document_, next), delta::diff(next, document_), {}, next_id_++ };
+
+	if (version % snapshot_interval_ == 0)
+	{
+		entry.snapshot = next.duplicate(true);
+	}
+
+	const auto forward_bytes { detail::approx_size(entry.forward) + detail::approx_size(entry.snapshot) };
+	const auto backward_bytes { detail::approx_size(entry.backward) };
+	const auto lease { std::make_shared<Lease>(self_, version, entry.id) };
+
+	versions_.push_back(std::move(entry));
+
+	action->add_do(Step{ lease, version, forward_bytes });
+	action->add_undo(Step{ lease, version - 1, backward_bytes });
+}
+
+inline auto DocumentHistory::at(int64_t version) const -> const Version&
+{
+	return versions_[size_t(version - first_)];
+}
+
+// The action leading to version is gone. If it was behind the current
+// version, nothing before version can be reached any more; if it was
+// ahead, nothing from version on can.
+inline auto DocumentHistory::release(int64_t version, uint64_t id) -> void
+{
+	// Already discarded by record()
+	if (version < first_ || version >= get_version_count() || at(version).id != id) return;
+
+	if (version > current_)
+	{
+		versions_.resize(size_t(version - first_));
+		return;
+	}
+
+	oldest_ = std::max(oldest_, version);
+
+	// Keep the snapshot that versions from oldest_ on are rebuilt from
+	const auto keep { oldest_ - oldest_ % snapshot_interval_ };
+
+	while (first_ < keep)
+	{
+		versions_.pop_front();
+		first_++;
+	}
+}
+
+// Steps the live document to version one delta at a time, which for
+// undo/redo is a single patch
+inline auto DocumentHistory::seek(int64_t version) -> void
+{
+	assert (version >= first_ && version < get_version_count());
+
+	if (std::abs(version - current_) > snapshot_interval_)
+	{
+		document_ = get(version);
+		current_ = version;
+	}
+
+	while (current_ < version)
+	{
+		delta::apply(document_, at(++current_).forward);
+	}
+
+	while (current_ > version)
+	{
+		delta::apply(document_, at(current_--).backward);
+	}
+
+	on_changed_(document_);
+}
+
+// +++ DocumentHistory::Lease +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+inline DocumentHistory::Lease::~Lease()
+{
+	if (const auto self { owner.lock() })
+	{
+		(*self)->release(version, id);
+	}
+}
+
+// +++ DocumentHistory::Step ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+inline auto DocumentHistory::Step::operator()() -> void
+{
+	if (const auto self { lease->owner.lock() })
+	{
+		(*self)->seek(target);
+	}
+}
+
+inline auto DocumentHistory::Step::approx_size() const -> size_t
+{
+	return reported_bytes;
+}
+
+} // gdn
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace gdn {
+
+// A std::function replacement that stores callables of up to Capacity
+// bytes inside itself, so that assigning and calling them never allocates.
+// Bigger callables, or ones that can't be moved without throwing, are kept
+// on the heap like std::function would, so any callable std::function
+// accepts works here too. Code that must not allocate can check
+// stores_inline<F> in a static_assert.
+template <typename Signature, size_t Capacity = 4 * sizeof(void*)>
+class InlineFunction;
+
+template <typename R, typename ...Args, size_t Capacity>
+class InlineFunction<R(Args...), Capacity>
+{
+public:
+
+	InlineFunction() = default;
+	InlineFunction(std::nullptr_t) {}
+
+	template <typename F>
+		requires (!std::is_same_v<std::decay_t<F>, InlineFunction> && std::is_invocable_r_v<R, std::decay_t<F>&, Args...>)
+	InlineFunction(F&& f);
+
+	InlineFunction(const InlineFunction& rhs);
+	InlineFunction(InlineFunction&& rhs) noexcept;
+	auto operator=(const InlineFunction& rhs) -> InlineFunction&;
+	auto operator=(InlineFunction&& rhs) noexcept -> InlineFunction&;
+	auto operator=(std::nullptr_t) -> InlineFunction&;
+	~InlineFunction();
+
+	explicit operator bool() const { return vtable_ != nullptr; }
+
+	auto operator()(Args... args) const -> R;
+
+	template <typename F>
+	static constexpr bool stores_inline
+	{
+		sizeof(F) <= Capacity &&
+		alignof(F) <= alignof(std::max_align_t) &&
+		std::is_nothrow_move_constructible_v<F>
+	};
+
+private:
+
+	struct VTable
+	{
+		R (*invoke)(void* f, Args&&... args);
+		void (*copy)(void* to, const void* from);
+		void (*move)(void* to, void* from);
+		void (*destroy)(void* f);
+	};
+
+	template <typename F>
+	static constexpr VTable VTABLE
+	{
+		[](void* f, Args&&... args) -> R { return std::invoke(*static_cast<F*>(f), std::forward<Args>(args)...); },
+		[](void* to, const void* from) { new (to) F(*static_cast<const F*>(from)); },
+		[](void* to, void* from) { new (to) F(std::move(*static_cast<F*>(from))); },
+		[](void* f) { static_cast<F*>(f)->~F(); },
+	};
+
+	// The storage holds an owning F* instead
+	template <typename F>
+	static constexpr VTable HEAP_VTABLE
+	{
+		[](void* f, Args&&... args) -> R { return std::invoke(**static_cast<F**>(f), std::forward<Args>(args)...); },
+		[](void* to, const void* from) { new (to) F*(new F(**static_cast<F* const*>(from))); },
+		[](void* to, void* from) { new (to) F*(std::exchange(*static_cast<F**>(from), nullptr)); },
+		[](void* f) { delete *static_cast<F**>(f); },
+	};
+
+	auto reset() -> void;
+
+	// mutable for the same reason std::function::operator() is const
+	alignas(std::max_align_t) mutable unsigned char storage_[Capacity];
+	const VTable* vtable_{};
+};
+
+// +++ InlineFunction +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+template <typename R, typename ...Args, size_t Capacity>
+template <typename F>
+	requires (!std::is_same_v<std::decay_t<F>, InlineFunction<R(Args...), Capacity>> && std::is_invocable_r_v<R, std::decay_t<F>&, Args...>)
+InlineFunction<R(Args...), Capacity>::InlineFunction(F&& f)
+{
+	using T = std::decay_t<F>;
+
+	static_assert(sizeof(T*) <= Capacity, "InlineFunction needs room for at least a pointer");
+
+	// Null function pointers and empty std::functions stay empty, as
+	// they would in a std::function, instead of throwing when called
+	if constexpr (std::is_constructible_v<bool, const T&>)
+	{
+		if (!static_cast<bool>(f)) return;
+	}
+
+	if constexpr (stores_inline<T>)
+	{
+		new (storage_) T(std::forward<F>(f));
+
+		vtable_ = &VTABLE<T>;
+	}
+	else
+	{
+		new (storage_) T*(new T(std::forward<F>(f)));
+
+		vtable_ = &HEAP_VTABLE<T>;
+	}
+}
+
+template <typename R, typename ...Args, size_t Capacity>
+InlineFunction<R(Args...), Capacity>::InlineFunction(const InlineFunction& rhs)
+	: vtable_{rhs.vtable_}
+{
+	if (vtable_) vtable_->copy(storage_, rhs.storage_);
+}
+
+template <typename R, typename ...Args, size_t Capacity>
+InlineFunction<R(Args...), Capacity>::InlineFunction(InlineFunction&& rhs) noexcept
+	: vtable_{rhs.vtable_}
+{
+	if (vtable_) vtable_->move(storage_, rhs.storage_);
+}
+
+template <typename R, typename ...Args, size_t Capacity>
+auto InlineFunction<R(Args...), Capacity>::operator=(const InlineFunction& rhs) -> InlineFunction&
+{
+	if (this == &rhs) return *this;
+
+	reset();
+
+	if (rhs.vtable_)
+	{
+		rhs.vtable_->copy(storage_, rhs.storage_);
+		vtable_ = rhs.vtable_;
+	}
+
+	return *this;
+}
+
+template <typename R, typename ...Args, size_t Capacity>
+auto InlineFunction<R(Args...), Capacity>::operator=(InlineFunction&& rhs) noexcept -> InlineFunction&
+{
+	if (this == &rhs) return *this;
+
+	reset();
+
+	if (rhs.vtable_)
+	{
+		rhs.vtable_->move(storage_, rhs.storage_);
+		vtable_ = rhs.vtable_;
+	}
+
+	return *this;
+}
+
+template <typename R, typename ...Args, size_t Capacity>
+auto InlineFunction<R(Args...), Capacity>::operator=(std::nullptr_t) -> InlineFunction&
+{
+	reset();
+
+	return *this;
+}
+
+template <typename R, typename ...Args, size_t Capacity>
+InlineFunction<R(Args...), Capacity>::~InlineFunction()
+{
+	reset();
+}
+
+template <typename R, typename ...Args, size_t Capacity>
+auto InlineFunction<R(Args...), Capacity>::operator()(Args... args) const -> R
+{
+	if (!vtable_) throw std::bad_function_call{};
+
+	return vtable_->invoke(storage_, std::forward<Args>(args)...);
+}
+
+template <typename R, typename ...Args, size_t Capacity>
+auto InlineFunction<R(Args...), Capacity>::reset() -> void
+{
+	if (!vtable_) return;
+
+	vtable_->destroy(storage_);
+	vtable_ = nullptr;
+}
+
+} // gdn
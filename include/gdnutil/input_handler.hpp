@@ -1,27 +1,260 @@
 #pragma once
 
-#include <functional>
+#include <algorithm>
+#include <cstdint>
 #include <map>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #pragma warning(push, 0)
 #include <GlobalConstants.hpp>
+#include <Engine.hpp>
 #include <Input.hpp>
+#include <InputEventAction.hpp>
+#include <InputEventJoypadButton.hpp>
+#include <InputEventJoypadMotion.hpp>
 #include <InputEventKey.hpp>
 #include <InputEventMouseButton.hpp>
 #include <InputEventMouseMotion.hpp>
+#include <InputMap.hpp>
 #include <SceneTree.hpp>
 #pragma warning(pop)
 
+#include "inline_function.hpp"
+
 namespace gdn {
 
+namespace detail {
+
+// The InputMap actions each event could trigger, keyed by the event's type
+// and its scancode, button or axis, so that an event is only tested against
+// the few actions that could match it. Shared by every InputHandler.
+//
+// Godot doesn't signal InputMap changes, so on the first lookup of each
+// frame the index checks the number of actions and the bindings of one
+// action, taking turns, and is rebuilt if they changed. Added and removed
+// actions are noticed on the next frame, remapped ones within as many
+// frames as there are actions. InputHandler::input_map_changed() makes a
+// change apply immediately.
+//
+// Created on first use and freed by release(), since the Strings it holds
+// can't be destroyed after GDNative terminates. If release() is never
+// called it's leaked at exit rather than destroyed then.
+class ActionIndex
+{
+public:
+
+	static ActionIndex& get()
+	{
+		if (!instance_) instance_ = new ActionIndex;
+
+		return *instance_;
+	}
+
+	static void release()
+	{
+		delete std::exchange(instance_, nullptr);
+	}
+
+	void invalidate()
+	{
+		valid_ = false;
+	}
+
+	// Names of the actions event might trigger, in name order, or null
+	const std::vector<godot::String>* find(const godot::Ref<godot::InputEvent>& event)
+	{
+		const godot::Ref<godot::InputEventAction> action = event;
+
+		if (action.is_valid())
+		{
+			action_ = { action->get_action() };
+
+			return &action_;
+		}
+
+		if (!valid_ || map_changed()) rebuild();
+
+		const auto signature = get_signature(event);
+		const auto pos = signature ? actions_.find(*signature) : actions_.end();
+
+		if (pos != actions_.end()) return &pos->second;
+
+		return unindexed_.empty() ? nullptr : &unindexed_;
+	}
+
+private:
+
+	enum class Kind : uint64_t
+	{
+		key,
+		mouse_button,
+		joypad_button,
+		joypad_motion,
+	};
+
+	static uint64_t make_signature(Kind kind, int64_t code)
+	{
+		return (uint64_t(kind) << 32) | uint32_t(code);
+	}
+
+	static std::optional<uint64_t> get_signature(const godot::Ref<godot::InputEvent>& event)
+	{
+		if (const godot::Ref<godot::InputEventKey> key = event; key.is_valid())
+		{
+			// Physical key events have no scancode to index them by
+			if (key->get_scancode() == 0) return std::nullopt;
+
+			return make_signature(Kind::key, key->get_scancode());
+		}
+
+		if (const godot::Ref<godot::InputEventMouseButton> mb = event; mb.is_valid())
+		{
+			return make_signature(Kind::mouse_button, mb->get_button_index());
+		}
+
+		if (const godot::Ref<godot::InputEventJoypadButton> button = event; button.is_valid())
+		{
+			return make_signature(Kind::joypad_button, button->get_button_index());
+		}
+
+		if (const godot::Ref<godot::InputEventJoypadMotion> motion = event; motion.is_valid())
+		{
+			return make_signature(Kind::joypad_motion, motion->get_axis());
+		}
+
+		return std::nullopt;
+	}
+
+	// Hash of an action's name and the signatures of its events
+	static uint64_t fingerprint(godot::InputMap* input_map, const godot::String& name)
+	{
+		const auto events = input_map->get_action_list(name);
+
+		uint64_t out = name.hash();
+
+		const auto mix = [&out](uint64_t value)
+		{
+			out = (out ^ value) * 1099511628211ull;
+		};
+
+		mix(events.size());
+
+		for (int i = 0; i < events.size(); i++)
+		{
+			const godot::Ref<godot::InputEvent> event = events[i];
+			const auto signature = get_signature(event);
+
+			mix(signature ? *signature : ~uint64_t(0));
+		}
+
+		return out;
+	}
+
+	bool map_changed()
+	{
+		const auto frame = godot::Engine::get_singleton()->get_idle_frames();
+
+		if (frame == checked_frame_) return false;
+
+		checked_frame_ = frame;
+
+		const auto input_map = godot::InputMap::get_singleton();
+		const auto action_names = input_map->get_actions();
+
+		if (size_t(action_names.size()) != fingerprints_.size()) return true;
+		if (fingerprints_.empty()) return false;
+
+		probe_ = (probe_ + 1) % fingerprints_.size();
+
+		return fingerprint(input_map, action_names[int(probe_)]) != fingerprints_[probe_];
+	}
+
+	static void add(std::vector<godot::String>* names, const godot::String& name)
+	{
+		if (names->empty() || names->back() != name) names->push_back(name);
+	}
+
+	void rebuild()
+	{
+		actions_.clear();
+		unindexed_.clear();
+
+		const auto input_map = godot::InputMap::get_singleton();
+		const auto action_names = input_map->get_actions();
+
+		std::vector<godot::String> names;
+
+		names.reserve(action_names.size());
+		fingerprints_.clear();
+
+		for (int i = 0; i < action_names.size(); i++)
+		{
+			names.push_back(action_names[i]);
+			fingerprints_.push_back(fingerprint(input_map, names.back()));
+		}
+
+		// Same order as InputHandler::Config::actions
+		std::sort(names.begin(), names.end());
+
+		for (const auto& name : names)
+		{
+			const auto events = input_map->get_action_list(name);
+
+			for (int i = 0; i < events.size(); i++)
+			{
+				const godot::Ref<godot::InputEvent> event = events[i];
+				const auto signature = get_signature(event);
+
+				add(signature ? &actions_[*signature] : &unindexed_, name);
+			}
+		}
+
+		// Actions with unindexable events are candidates for every event
+		if (!unindexed_.empty())
+		{
+			for (auto& [signature, candidates] : actions_)
+			{
+				candidates.insert(candidates.end(), unindexed_.begin(), unindexed_.end());
+
+				std::sort(candidates.begin(), candidates.end());
+
+				candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+			}
+		}
+
+		checked_frame_ = godot::Engine::get_singleton()->get_idle_frames();
+		valid_ = true;
+	}
+
+	std::unordered_map<uint64_t, std::vector<godot::String>> actions_;
+	std::vector<godot::String> unindexed_;
+	std::vector<godot::String> action_;
+	std::vector<uint64_t> fingerprints_; // in InputMap order
+	size_t probe_ = 0;
+	int64_t checked_frame_ = -1;
+	bool valid_ = false;
+
+	static inline ActionIndex* instance_ = nullptr;
+};
+
+} // detail
+
 class InputHandler
 {
 public:
 
-	using Task = std::function<void(godot::Ref<godot::InputEvent>)>;
-	using MBTask = std::function<void(godot::Ref<godot::InputEventMouseButton>)>;
-	using MMTask = std::function<void(godot::Ref<godot::InputEventMouseMotion>)>;
-	using KeyTask = std::function<void(godot::Ref<godot::InputEventKey>)>;
+	// Handed the event by reference, so dispatching doesn't touch the
+	// event's reference count. Lambdas capturing up to four pointers are
+	// stored inline, which keeps a handler about the size it was with
+	// std::function; bigger callables, including a wrapped std::function
+	// on MSVC, are allocated once, when assigned
+	using Task = InlineFunction<void(const godot::Ref<godot::InputEvent>&)>;
+	using MBTask = InlineFunction<void(const godot::Ref<godot::InputEventMouseButton>&)>;
+	using MMTask = InlineFunction<void(const godot::Ref<godot::InputEventMouseMotion>&)>;
+	using KeyTask = InlineFunction<void(const godot::Ref<godot::InputEventKey>&)>;
 
 	struct Config
 	{
@@ -57,7 +290,18 @@ public:
 		{
 			MMTask on_event;
 
-			operator bool() const { return on_event.operator bool(); }
+			// Called with every motion event, coalesced or not, for
+			// handlers that need each sample (e.g. freehand strokes)
+			MMTask on_sample;
+
+			// Deliver at most one motion event per frame to on_event,
+			// carrying the summed relative motion of the events it stands
+			// for and the latest of everything else. Held motion goes out
+			// before any other event, on the first motion of a new frame,
+			// or when flush() is called
+			bool coalesce = false;
+
+			operator bool() const { return on_event || on_sample; }
 		} mm;
 
 		struct Key
@@ -92,16 +336,57 @@ public:
 		if (enabled_ == yes) return;
 
 		enabled_ = yes;
+
+		// Held motion belongs to whatever the handler was doing before
+		if (!yes) pending_mm_.unref();
 	}
 
-	void operator()(godot::Ref<godot::InputEvent> event)
+	// Delivers motion held back by Config::MM::coalesce. Call it from
+	// _process() so a frame's last motion isn't held until the next event.
+	// Coalesced events are a single scratch event refilled each time, so
+	// handlers mustn't keep a reference to it
+	void flush()
 	{
-		if (!enabled_ && !state.mb.left.pressed && !state.mb.right.pressed) return;
+		if (pending_mm_.is_null()) return;
+
+		auto mm = pending_mm_;
+
+		pending_mm_.unref();
+
+		if (!_accepts_input()) return;
+
+		if (pending_mm_count_ > 1)
+		{
+			mm = _coalesced_mm(mm);
+		}
+
+		config.mm.on_event(mm);
+	}
+
+	// Changes to the InputMap are noticed within a few frames; call this
+	// after adding, removing or remapping actions for them to apply
+	// immediately
+	static void input_map_changed()
+	{
+		detail::ActionIndex::get().invalidate();
+	}
+
+	// Frees the action index shared by all handlers. Call it from the
+	// library's terminate hook, see gdn::terminate()
+	static void release()
+	{
+		detail::ActionIndex::release();
+	}
+
+	void operator()(const godot::Ref<godot::InputEvent>& event)
+	{
+		if (!_accepts_input()) return;
 
 		godot::Ref<godot::InputEventMouseButton> mb = event;
 
 		if (mb.is_valid())
 		{
+			flush();
 			_mb(mb);
 			return;
 		}
@@ -112,11 +397,13 @@ public:
 
 			if (mm.is_valid())
 			{
-				config.mm.on_event(mm);
+				_mm(mm);
 				return;
 			}
 		}
 
+		flush();
+
 		if (config.key)
 		{
 			godot::Ref<godot::InputEventKey> key = event;
@@ -128,8 +415,20 @@ public:
 			}
 		}
 
-		for (const auto& [ name, callbacks ] : config.actions)
+		if (config.actions.empty()) return;
+
+		const auto names = detail::ActionIndex::get().find(event);
+
+		if (!names) return;
+
+		for (const auto& name : *names)
 		{
+			const auto pos = config.actions.find(name);
+
+			if (pos == config.actions.end()) continue;
+
+			const auto& callbacks = pos->second;
+
 			if (callbacks.on_pressed && event->is_action_pressed(name))
 			{
 				callbacks.on_pressed(event);
@@ -146,7 +445,68 @@ public:
 
 private:
 
-	void _mb(godot::Ref<godot::InputEventMouseButton> mb)
+	// A drag that started while enabled carries on after disabling
+	bool _accepts_input() const
+	{
+		return enabled_ || state.mb.left.pressed || state.mb.right.pressed;
+	}
+
+	// Copies latest into the scratch event, with the summed relative motion
+	godot::Ref<godot::InputEventMouseMotion> _coalesced_mm(const godot::Ref<godot::InputEventMouseMotion>& latest)
+	{
+		if (scratch_mm_.is_null())
+		{
+			scratch_mm_ = godot::Ref<godot::InputEventMouseMotion>(godot::InputEventMouseMotion::_new());
+		}
+
+		scratch_mm_->set_device(latest->get_device());
+		scratch_mm_->set_alt(latest->get_alt());
+		scratch_mm_->set_shift(latest->get_shift());
+		scratch_mm_->set_control(latest->get_control());
+		scratch_mm_->set_metakey(latest->get_metakey());
+		scratch_mm_->set_button_mask(latest->get_button_mask());
+		scratch_mm_->set_position(latest->get_position());
+		scratch_mm_->set_global_position(latest->get_global_position());
+		scratch_mm_->set_pressure(latest->get_pressure());
+		scratch_mm_->set_tilt(latest->get_tilt());
+		scratch_mm_->set_speed(latest->get_speed());
+		scratch_mm_->set_relative(pending_mm_relative_);
+
+		return scratch_mm_;
+	}
+
+	void _mm(const godot::Ref<godot::InputEventMouseMotion>& mm)
+	{
+		if (config.mm.on_sample) config.mm.on_sample(mm);
+
+		if (!config.mm.on_event) return;
+
+		if (!config.mm.coalesce)
+		{
+			config.mm.on_event(mm);
+			return;
+		}
+
+		const auto frame = godot::Engine::get_singleton()->get_idle_frames();
+
+		if (pending_mm_.is_valid() && frame != pending_mm_frame_)
+		{
+			flush();
+		}
+
+		if (pending_mm_.is_null())
+		{
+			pending_mm_relative_ = {};
+			pending_mm_count_ = 0;
+			pending_mm_frame_ = frame;
+		}
+
+		pending_mm_ = mm;
+		pending_mm_relative_ += mm->get_relative();
+		pending_mm_count_++;
+	}
+
+	void _mb(const godot::Ref<godot::InputEventMouseButton>& mb)
 	{
 		if (config.mb.on_double_click && mb->is_doubleclick())
 		{
@@ -187,14 +547,14 @@ private:
 		}
 	}
 	
-	void _mb(const Config::MB::Button& config, State::MB::Button* state, const godot::Ref<godot::InputEventMouseButton> mb)
+	void _mb(const Config::MB::Button& config, State::MB::Button* state, const godot::Ref<godot::InputEventMouseButton>& mb)
 	{
 		state->pressed = mb->is_pressed();
 
 		_mb(config, mb);
 	}
 
-	void _mb(const Config::MB::Button& mb_config, const godot::Ref<godot::InputEventMouseButton> mb)
+	void _mb(const Config::MB::Button& mb_config, const godot::Ref<godot::InputEventMouseButton>& mb)
 	{
 		if (mb_config.on_event) mb_config.on_event(mb);
 		if (config.mb.any.on_event) config.mb.any.on_event(mb);
@@ -212,6 +572,11 @@ private:
 	}
 
 	bool enabled_ = true;
+	godot::Ref<godot::InputEventMouseMotion> pending_mm_;
+	godot::Ref<godot::InputEventMouseMotion> scratch_mm_;
+	godot::Vector2 pending_mm_relative_;
+	int pending_mm_count_ = 0;
+	int64_t pending_mm_frame_ = 0;
 };
 
 }
\ No newline at end of file
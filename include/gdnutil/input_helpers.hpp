@@ -5,6 +5,8 @@
 #include <InputEventMouseButton.hpp>
 #include <InputEventMouseMotion.hpp>
 #include <InputEventPanGesture.hpp>
+#include <InputEventWithModifiers.hpp>
+#include <cstdint>
 #include <optional>
 
 namespace gdn::concepts {
@@ -168,4 +170,124 @@ auto get_key_pressed_no_echo(Ref<InputEvent> event, int64_t scancode) -> std::op
 [[nodiscard]] inline auto is_mb_wheel_up_pressed(Ref<InputEvent> event) -> bool           { return is_mb(event, fn::mb::is_wheel_up(), fn::mb::is_pressed()); }
 [[nodiscard]] inline auto is_mb_wheel_down_pressed(Ref<InputEvent> event) -> bool         { return is_mb(event, fn::mb::is_wheel_down(), fn::mb::is_pressed()); }
 
+// What the predicates above look at, read out of an event in one go. A
+// handler testing several conditions pays for one cast instead of one per
+// test, and the overloads below make no further Godot calls:
+//
+//   const auto info { gdn::classify(event) };
+//
+//   if (gdn::is_mb_left_pressed(info)) ...
+//   else if (gdn::is_key_pressed(info, GlobalConstants::KEY_ESCAPE)) ...
+struct EventInfo {
+	enum class Kind : uint8_t { other, key, mouse_button, mouse_motion, pan_gesture };
+	enum Modifier : uint8_t { alt = 1, shift = 2, control = 4, meta = 8, command = 16 };
+
+	Kind kind{Kind::other};
+	bool pressed{false};
+	bool echo{false};
+	bool doubleclick{false};
+	uint8_t modifiers{0};
+	int64_t button{0};
+	int64_t scancode{0};
+	Vector2 position;
+
+	// Mouse motion relative, pan gesture delta
+	Vector2 relative;
+
+	[[nodiscard]] auto has_modifiers(uint8_t mask) const -> bool { return (modifiers & mask) == mask; }
+};
+
+namespace detail {
+
+[[nodiscard]] inline
+auto get_modifiers(const InputEventWithModifiers& event) -> uint8_t {
+	return uint8_t(
+		(event.get_alt() ? EventInfo::alt : 0) |
+		(event.get_shift() ? EventInfo::shift : 0) |
+		(event.get_control() ? EventInfo::control : 0) |
+		(event.get_metakey() ? EventInfo::meta : 0) |
+		(event.get_command() ? EventInfo::command : 0));
+}
+
+} // detail
+
+// Casts the raw pointer rather than through Ref<>, which would also take
+// and drop a reference per attempt. Motion is tried first as the most
+// frequent event
+[[nodiscard]] inline
+auto classify(const Ref<InputEvent>& event) -> EventInfo {
+	EventInfo info;
+	if (event.is_null()) {
+		return info;
+	}
+	if (const auto mm = Object::cast_to<InputEventMouseMotion>(event.ptr())) {
+		info.kind = EventInfo::Kind::mouse_motion;
+		info.modifiers = detail::get_modifiers(*mm);
+		info.position = mm->get_position();
+		info.relative = mm->get_relative();
+		return info;
+	}
+	if (const auto mb = Object::cast_to<InputEventMouseButton>(event.ptr())) {
+		info.kind = EventInfo::Kind::mouse_button;
+		info.pressed = mb->is_pressed();
+		info.doubleclick = mb->is_doubleclick();
+		info.modifiers = detail::get_modifiers(*mb);
+		info.button = mb->get_button_index();
+		info.position = mb->get_position();
+		return info;
+	}
+	if (const auto key = Object::cast_to<InputEventKey>(event.ptr())) {
+		info.kind = EventInfo::Kind::key;
+		info.pressed = key->is_pressed();
+		info.echo = key->is_echo();
+		info.modifiers = detail::get_modifiers(*key);
+		info.scancode = key->get_scancode();
+		return info;
+	}
+	if (const auto pan = Object::cast_to<InputEventPanGesture>(event.ptr())) {
+		info.kind = EventInfo::Kind::pan_gesture;
+		info.modifiers = detail::get_modifiers(*pan);
+		info.position = pan->get_position();
+		info.relative = pan->get_delta();
+		return info;
+	}
+	return info;
+}
+
+namespace detail {
+
+[[nodiscard]] inline auto is_mb(const EventInfo& info, int64_t button, bool pressed) -> bool {
+	return info.kind == EventInfo::Kind::mouse_button && info.button == button && info.pressed == pressed;
+}
+
+} // detail
+
+[[nodiscard]] inline auto is_key(const EventInfo& info) -> bool                                   { return info.kind == EventInfo::Kind::key; }
+[[nodiscard]] inline auto is_mb(const EventInfo& info) -> bool                                    { return info.kind == EventInfo::Kind::mouse_button; }
+[[nodiscard]] inline auto is_mm(const EventInfo& info) -> bool                                    { return info.kind == EventInfo::Kind::mouse_motion; }
+[[nodiscard]] inline auto is_pan_gesture(const EventInfo& info) -> bool                           { return info.kind == EventInfo::Kind::pan_gesture; }
+[[nodiscard]] inline auto is_key(const EventInfo& info, int64_t scancode) -> bool                 { return is_key(info) && info.scancode == scancode; }
+[[nodiscard]] inline auto is_key_pressed(const EventInfo& info, int64_t scancode) -> bool         { return is_key(info, scancode) && info.pressed; }
+[[nodiscard]] inline auto is_mb_any_pressed(const EventInfo& info) -> bool                        { return is_mb(info) && info.pressed; }
+[[nodiscard]] inline auto is_mb_any_released(const EventInfo& info) -> bool                       { return is_mb(info) && !info.pressed; }
+[[nodiscard]] inline auto is_mb_left_doubleclick(const EventInfo& info) -> bool                   { return is_mb(info) && info.button == GlobalConstants::BUTTON_LEFT && info.doubleclick; }
+[[nodiscard]] inline auto is_mb_left_pressed(const EventInfo& info) -> bool                       { return detail::is_mb(info, GlobalConstants::BUTTON_LEFT, true); }
+[[nodiscard]] inline auto is_mb_left_released(const EventInfo& info) -> bool                      { return detail::is_mb(info, GlobalConstants::BUTTON_LEFT, false); }
+[[nodiscard]] inline auto is_mb_middle_pressed(const EventInfo& info) -> bool                     { return detail::is_mb(info, GlobalConstants::BUTTON_MIDDLE, true); }
+[[nodiscard]] inline auto is_mb_middle_released(const EventInfo& info) -> bool                    { return detail::is_mb(info, GlobalConstants::BUTTON_MIDDLE, false); }
+[[nodiscard]] inline auto is_mb_right_pressed(const EventInfo& info) -> bool                      { return detail::is_mb(info, GlobalConstants::BUTTON_RIGHT, true); }
+[[nodiscard]] inline auto is_mb_right_released(const EventInfo& info) -> bool                     { return detail::is_mb(info, GlobalConstants::BUTTON_RIGHT, false); }
+[[nodiscard]] inline auto is_mb_wheel_up_pressed(const EventInfo& info) -> bool                   { return detail::is_mb(info, GlobalConstants::BUTTON_WHEEL_UP, true); }
+[[nodiscard]] inline auto is_mb_wheel_down_pressed(const EventInfo& info) -> bool                 { return detail::is_mb(info, GlobalConstants::BUTTON_WHEEL_DOWN, true); }
+
+[[nodiscard]] inline
+auto get_key_pressed(const EventInfo& info, int64_t scancode) -> std::optional<bool> {
+	return is_key(info, scancode) ? std::optional{info.pressed} : std::nullopt;
+}
+
+[[nodiscard]] inline
+auto get_key_pressed_no_echo(const EventInfo& info, int64_t scancode) -> std::optional<bool> {
+	return is_key(info, scancode) && !info.echo ? std::optional{info.pressed} : std::nullopt;
+}
+
 } // gdn
@@ -0,0 +1,456 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+#pragma warning(push, 0)
+#include <Engine.hpp>
+#include <InputEventKey.hpp>
+#include <InputEventMouseButton.hpp>
+#include <InputEventMouseMotion.hpp>
+#include <InputEventPanGesture.hpp>
+#pragma warning(pop)
+
+#include "input_helpers.hpp"
+
+namespace gdn {
+
+// Records the input events a control or node receives, with the frame
+// each arrived on, so that a session can be replayed exactly:
+//
+//   void _gui_input(Ref<InputEvent> event)
+//   {
+//     if (recorder_) recorder_->record(event);
+//     input_handler_(event);
+//   }
+//
+//   recorder.save(session_path);
+//
+// and later, headless,
+//
+//   auto replay { gdn::InputReplay::load(path) };
+//
+//   while (replay.advance([&](const Ref<InputEvent>& event) { control->_gui_input(event); }))
+//   {
+//     // run a frame
+//   }
+//
+// Keys, mouse buttons, mouse motion and pan gestures are recorded; other
+// events are counted and dropped. The log is a header (magic "GDNI" and a
+// version) followed by fixed-size little endian records, one per event:
+//
+//   frame     uint32  frames since recording started
+//   kind      uint8   EventInfo::Kind
+//   flags     uint8   pressed, echo, doubleclick
+//   modifiers uint8   EventInfo::Modifier bits
+//   device    int32
+//   ...               kind specific fields, see write_event()
+//
+// Fields are copied in native byte order, so only little endian hosts are
+// supported; that keeps recordings readable on every machine that is.
+
+namespace input_recording {
+
+static_assert (std::endian::native == std::endian::little);
+
+static constexpr char MAGIC[4] { 'G', 'D', 'N', 'I' };
+static constexpr uint32_t FORMAT_VERSION { 2 };
+static constexpr size_t HEADER_SIZE { 8 };
+
+enum Flag : uint8_t
+{
+	pressed = 1,
+	echo = 2,
+	doubleclick = 4,
+};
+
+namespace detail {
+
+template <typename T>
+auto put(const T& value, std::vector<uint8_t>* out) -> void
+{
+	const auto at { out->size() };
+
+	out->resize(at + sizeof(T));
+	std::memcpy(out->data() + at, &value, sizeof(T));
+}
+
+inline auto put(godot::Vector2 value, std::vector<uint8_t>* out) -> void
+{
+	put(float(value.x), out);
+	put(float(value.y), out);
+}
+
+class Cursor
+{
+public:
+
+	Cursor(const uint8_t* at, const uint8_t* end) : at_{at}, end_{end} {}
+
+	auto at_end() const -> bool { return at_ == end_; }
+	auto position() const -> const uint8_t* { return at_; }
+
+	template <typename T>
+	auto get() -> T
+	{
+		if (size_t(end_ - at_) < sizeof(T))
+		{
+			throw std::runtime_error("Corrupt input recording");
+		}
+
+		T out;
+
+		std::memcpy(&out, at_, sizeof(T));
+		at_ += sizeof(T);
+
+		return out;
+	}
+
+	auto get_vector2() -> godot::Vector2
+	{
+		const auto x { get<float>() };
+		const auto y { get<float>() };
+
+		return { x, y };
+	}
+
+private:
+
+	const uint8_t* at_;
+	const uint8_t* end_;
+};
+
+// Command isn't set, since it's an alias of control (meta on Apple) and
+// setting it would overwrite what was recorded for that key
+inline auto set_modifiers(godot::InputEventWithModifiers* event, uint8_t modifiers) -> void
+{
+	event->set_alt(modifiers & EventInfo::alt);
+	event->set_shift(modifiers & EventInfo::shift);
+	event->set_control(modifiers & EventInfo::control);
+	event->set_metakey(modifiers & EventInfo::meta);
+}
+
+// Appends one record, or returns false for an event type that isn't recorded
+inline auto write_event(uint32_t frame, const godot::Ref<godot::InputEvent>& event, std::vector<uint8_t>* out) -> bool
+{
+	const auto info { classify(event) };
+
+	if (info.kind == EventInfo::Kind::other) return false;
+
+	put(frame, out);
+	put(uint8_t(info.kind), out);
+	put(uint8_t((info.pressed ? Flag::pressed : 0) | (info.echo ? Flag::echo : 0) | (info.doubleclick ? Flag::doubleclick : 0)), out);
+	put(info.modifiers, out);
+	put(int32_t(event->get_device()), out);
+
+	switch (info.kind)
+	{
+		case EventInfo::Kind::key:
+		{
+			const auto key { godot::Object::cast_to<godot::InputEventKey>(event.ptr()) };
+
+			put(uint32_t(info.scancode), out);
+			put(uint32_t(key->get_physical_scancode()), out);
+			put(uint32_t(key->get_unicode()), out);
+			break;
+		}
+		case EventInfo::Kind::mouse_button:
+		{
+			const auto mb { godot::Object::cast_to<godot::InputEventMouseButton>(event.ptr()) };
+
+			put(int32_t(info.button), out);
+			put(int32_t(mb->get_button_mask()), out);
+			put(float(mb->get_factor()), out);
+			put(info.position, out);
+			put(mb->get_global_position(), out);
+			break;
+		}
+		case EventInfo::Kind::mouse_motion:
+		{
+			const auto mm { godot::Object::cast_to<godot::InputEventMouseMotion>(event.ptr()) };
+
+			put(int32_t(mm->get_button_mask()), out);
+			put(float(mm->get_pressure()), out);
+			put(info.position, out);
+			put(mm->get_global_position(), out);
+			put(info.relative, out);
+			put(mm->get_speed(), out);
+			put(mm->get_tilt(), out);
+			break;
+		}
+		case EventInfo::Kind::pan_gesture:
+		{
+			put(info.position, out);
+			put(info.relative, out);
+			break;
+		}
+		case EventInfo::Kind::other: break;
+	}
+
+	return true;
+}
+
+// Reads the record after its frame number
+inline auto read_event(Cursor* in) -> godot::Ref<godot::InputEvent>
+{
+	const auto kind { EventInfo::Kind(in->get<uint8_t>()) };
+	const auto flags { in->get<uint8_t>() };
+	const auto modifiers { in->get<uint8_t>() };
+	const auto device { in->get<int32_t>() };
+
+	const auto finish = [&](auto* event)
+	{
+		set_modifiers(event, modifiers);
+		event->set_device(device);
+
+		return godot::Ref<godot::InputEvent>(event);
+	};
+
+	switch (kind)
+	{
+		case EventInfo::Kind::key:
+		{
+			const auto key { godot::InputEventKey::_new() };
+
+			key->set_pressed(flags & Flag::pressed);
+			key->set_echo(flags & Flag::echo);
+			key->set_scancode(in->get<uint32_t>());
+			key->set_physical_scancode(in->get<uint32_t>());
+			key->set_unicode(in->get<uint32_t>());
+
+			return finish(key);
+		}
+		case EventInfo::Kind::mouse_button:
+		{
+			const auto mb { godot::InputEventMouseButton::_new() };
+
+			mb->set_pressed(flags & Flag::pressed);
+			mb->set_doubleclick(flags & Flag::doubleclick);
+			mb->set_button_index(in->get<int32_t>());
+			mb->set_button_mask(in->get<int32_t>());
+			mb->set_factor(in->get<float>());
+			mb->set_position(in->get_vector2());
+			mb->set_global_position(in->get_vector2());
+
+			return finish(mb);
+		}
+		case EventInfo::Kind::mouse_motion:
+		{
+			const auto mm { godot::InputEventMouseMotion::_new() };
+
+			mm->set_button_mask(in->get<int32_t>());
+			mm->set_pressure(in->get<float>());
+			mm->set_position(in->get_vector2());
+			mm->set_global_position(in->get_vector2());
+			mm->set_relative(in->get_vector2());
+			mm->set_speed(in->get_vector2());
+			mm->set_tilt(in->get_vector2());
+
+			return finish(mm);
+		}
+		case EventInfo::Kind::pan_gesture:
+		{
+			const auto pan { godot::InputEventPanGesture::_new() };
+
+			pan->set_position(in->get_vector2());
+			pan->set_delta(in->get_vector2());
+
+			return finish(pan);
+		}
+		case EventInfo::Kind::other: break;
+	}
+
+	throw std::runtime_error("Corrupt input recording");
+}
+
+} // detail
+} // input_recording
+
+class InputRecorder
+{
+public:
+
+	// Frames are counted from the one this is created on
+	InputRecorder();
+
+	auto record(const godot::Ref<godot::InputEvent>& event) -> void;
+
+	auto get_data() const -> const std::vector<uint8_t>&;
+	auto get_event_count() const -> size_t;
+
+	// Events of types that aren't recorded
+	auto get_skipped_count() const -> size_t;
+
+	auto save(const std::filesystem::path& path) const -> void;
+
+private:
+
+	std::vector<uint8_t> data_;
+	int64_t start_frame_;
+	size_t event_count_{0};
+	size_t skipped_count_{0};
+};
+
+class InputReplay
+{
+public:
+
+	InputReplay(std::vector<uint8_t> data);
+
+	static auto load(const std::filesystem::path& path) -> InputReplay;
+
+	// Passes visitor the events recorded on the current frame, in order,
+	// then moves on to the next frame. Returns false, doing nothing, once
+	// every event has been replayed. Frames are counted by calls rather
+	// than by the engine, so replay is the same however long frames take
+	template <typename Visitor>
+	auto advance(Visitor visitor) -> bool;
+
+	// Replays everything at once, for benchmarks that don't care about
+	// frame boundaries
+	template <typename Visitor>
+	auto play_all(Visitor visitor) -> void;
+
+	auto get_frame() const -> uint32_t;
+	auto is_finished() const -> bool;
+	auto rewind() -> void;
+
+private:
+
+	auto peek_frame() const -> uint32_t;
+
+	std::vector<uint8_t> data_;
+	size_t at_{input_recording::HEADER_SIZE};
+	uint32_t frame_{0};
+};
+
+// +++ InputRecorder ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+inline InputRecorder::InputRecorder()
+	: start_frame_{godot::Engine::get_singleton()->get_idle_frames()}
+{
+	data_.insert(data_.end(), std::begin(input_recording::MAGIC), std::end(input_recording::MAGIC));
+
+	input_recording::detail::put(input_recording::FORMAT_VERSION, &data_);
+}
+
+inline auto InputRecorder::record(const godot::Ref<godot::InputEvent>& event) -> void
+{
+	const auto frame { uint32_t(godot::Engine::get_singleton()->get_idle_frames() - start_frame_) };
+
+	if (input_recording::detail::write_event(frame, event, &data_)) event_count_++;
+	else skipped_count_++;
+}
+
+inline auto InputRecorder::get_data() const -> const std::vector<uint8_t>&
+{
+	return data_;
+}
+
+inline auto InputRecorder::get_event_count() const -> size_t
+{
+	return event_count_;
+}
+
+inline auto InputRecorder::get_skipped_count() const -> size_t
+{
+	return skipped_count_;
+}
+
+inline auto InputRecorder::save(const std::filesystem::path& path) const -> void
+{
+	std::ofstream file { path, std::ios::binary | std::ios::trunc };
+
+	file.write(reinterpret_cast<const char*>(data_.data()), std::streamsize(data_.size()));
+
+	if (!file)
+	{
+		throw std::runtime_error("Couldn't write input recording: " + path.string());
+	}
+}
+
+// +++ InputReplay ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+inline InputReplay::InputReplay(std::vector<uint8_t> data)
+	: data_{std::move(data)}
+{
+	namespace ir = input_recording;
+
+	if (data_.size() < ir::HEADER_SIZE || std::memcmp(data_.data(), ir::MAGIC, sizeof(ir::MAGIC)) != 0)
+	{
+		throw std::runtime_error("Not an input recording");
+	}
+
+	ir::detail::Cursor header { data_.data() + sizeof(ir::MAGIC), data_.data() + ir::HEADER_SIZE };
+
+	if (header.get<uint32_t>() != ir::FORMAT_VERSION)
+	{
+		throw std::runtime_error("Unsupported input recording version");
+	}
+}
+
+inline auto InputReplay::load(const std::filesystem::path& path) -> InputReplay
+{
+	std::ifstream file { path, std::ios::binary };
+
+	if (!file)
+	{
+		throw std::runtime_error("Couldn't open input recording: " + path.string());
+	}
+
+	return { std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {}) };
+}
+
+template <typename Visitor>
+auto InputReplay::advance(Visitor visitor) -> bool
+{
+	if (is_finished()) return false;
+
+	while (!is_finished() && peek_frame() <= frame_)
+	{
+		input_recording::detail::Cursor in { data_.data() + at_ + sizeof(uint32_t), data_.data() + data_.size() };
+
+		const auto event { input_recording::detail::read_event(&in) };
+
+		at_ = size_t(in.position() - data_.data());
+
+		visitor(event);
+	}
+
+	frame_++;
+
+	return true;
+}
+
+template <typename Visitor>
+auto InputReplay::play_all(Visitor visitor) -> void
+{
+	while (advance(visitor)) {}
+}
+
+inline auto InputReplay::get_frame() const -> uint32_t
+{
+	return frame_;
+}
+
+inline auto InputReplay::is_finished() const -> bool
+{
+	return at_ == data_.size();
+}
+
+inline auto InputReplay::rewind() -> void
+{
+	at_ = input_recording::HEADER_SIZE;
+	frame_ = 0;
+}
+
+inline auto InputReplay::peek_frame() const -> uint32_t
+{
+	return input_recording::detail::Cursor{ data_.data() + at_, data_.data() + data_.size() }.get<uint32_t>();
+}
+
+} // gdn
@@ -0,0 +1,690 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <Array.hpp>
+#include <Color.hpp>
+#include <Dictionary.hpp>
+#include <String.hpp>
+#include <Transform2D.hpp>
+
+namespace gdn {
+namespace json {
+
+// Pull-style JSON reader for documents too big to parse into a Variant
+// tree first. Reads a buffer in place, or a file a chunk at a time, and
+// hands values straight to typed visitors:
+//
+//   gdn::json::Reader reader { path };
+//
+//   reader.visit_object([&](std::string_view key)
+//   {
+//     if (key == "name") name = reader.read<godot::String>();
+//     else if (key == "layers") reader.visit_array([&] { layers.push_back(read_layer(reader)); });
+//   });
+//
+// A visitor consumes the value it's called for with read<T>(), one of the
+// visit functions or skip(); values it leaves alone are skipped for it.
+// Keys passed to visit_object visitors stay valid for the whole call.
+//
+// Numbers read as godot::Variant come back as floats, like Godot's own
+// parser, so Variant subtrees can still be read with the json:: getters.
+// Errors throw std::runtime_error with the line number.
+class Reader
+{
+public:
+
+	enum class Type
+	{
+		null,
+		boolean,
+		number,
+		string,
+		array,
+		object,
+		end,
+	};
+
+	explicit Reader(std::string_view buffer);
+	explicit Reader(const std::filesystem::path& path, size_t chunk_size = 1 << 16);
+	Reader(const Reader&) = delete;
+	auto operator=(const Reader&) -> Reader& = delete;
+
+	// Type of the next value, without consuming it
+	auto peek() -> Type;
+	auto get_line() const -> int64_t;
+
+	// bool, float, double, integers, godot::String, std::string,
+	// godot::Color, godot::Transform2D (as 4 and 6 element arrays),
+	// godot::Variant, godot::Array and godot::Dictionary
+	template <typename T> auto read() -> T;
+
+	template <typename Visitor> auto visit_object(Visitor visitor) -> void;
+	template <typename Visitor> auto visit_array(Visitor visitor) -> void;
+	template <typename T, typename Visitor> auto visit_array(Visitor visitor) -> void;
+	template <typename KeyType, typename ValueType, typename Visitor> auto visit_dictionary_items(Visitor visitor) -> void;
+
+	auto skip() -> void;
+
+private:
+
+	static constexpr int END { -1 };
+	static constexpr int MAX_DEPTH { 512 };
+
+	[[noreturn]] auto fail(const char* message) const -> void;
+
+	auto fill() -> bool;
+	auto peek_char() -> int;
+	auto get_char() -> int;
+	auto skip_whitespace() -> int;
+	auto expect(char c) -> void;
+	auto expect_word(const char* word) -> void;
+
+	// After a visitor returns: skips the value if it wasn't consumed, then
+	// eats the separator. Returns false at the closing bracket
+	auto next_item(char close, uint64_t values_before) -> bool;
+
+	auto read_null() -> void;
+	auto read_bool() -> bool;
+	auto read_number() -> double;
+	auto read_integer() -> int64_t;
+	auto read_string(std::string* out) -> void;
+	auto read_variant() -> godot::Variant;
+	auto read_number_token() -> std::string_view;
+	auto read_hex4() -> uint32_t;
+
+	auto enter() -> void;
+	auto leave() -> void;
+
+	std::ifstream file_;
+	std::vector<char> chunk_;
+	const char* data_{};
+	size_t size_{};
+	size_t pos_{};
+	int64_t line_{1};
+	int depth_{};
+	uint64_t values_{};
+	std::string string_;
+	std::string number_;
+	std::deque<std::string> keys_;
+};
+
+// Reads a whole document into a Reader and calls visitor(reader) with it,
+// checking nothing follows the root value
+template <typename Visitor>
+auto read_file(const std::filesystem::path& path, Visitor visitor) -> void
+{
+	Reader reader { path };
+
+	visitor(reader);
+
+	if (reader.peek() != Reader::Type::end)
+	{
+		throw std::runtime_error("Unexpected data after JSON document: " + path.string());
+	}
+}
+
+inline Reader::Reader(std::string_view buffer)
+	: data_{buffer.data()}
+	, size_{buffer.size()}
+{
+	if (buffer.starts_with("\xEF\xBB\xBF")) pos_ = 3;
+}
+
+inline Reader::Reader(const std::filesystem::path& path, size_t chunk_size)
+	: file_{path, std::ios::binary}
+	, chunk_(chunk_size)
+{
+	if (!file_)
+	{
+		throw std::runtime_error("Couldn't open file: " + path.string());
+	}
+
+	data_ = chunk_.data();
+
+	fill();
+
+	if (std::string_view{data_, size_}.starts_with("\xEF\xBB\xBF")) pos_ = 3;
+}
+
+inline auto Reader::peek() -> Type
+{
+	switch (skip_whitespace())
+	{
+		case END: return Type::end;
+		case 'n': return Type::null;
+		case 't':
+		case 'f': return Type::boolean;
+		case '"': return Type::string;
+		case '[': return Type::array;
+		case '{': return Type::object;
+		case '-':
+		case '0': case '1': case '2': case '3': case '4':
+		case '5': case '6': case '7': case '8': case '9': return Type::number;
+		default: fail("unexpected character");
+	}
+}
+
+inline auto Reader::get_line() const -> int64_t
+{
+	return line_;
+}
+
+template <typename T>
+auto Reader::read() -> T
+{
+	if constexpr (std::is_same_v<T, bool>)
+	{
+		return read_bool();
+	}
+	else if constexpr (std::is_integral_v<T>)
+	{
+		const auto value { read_integer() };
+
+		if (value < int64_t(std::numeric_limits<T>::min()) || (value > 0 && uint64_t(value) > uint64_t(std::numeric_limits<T>::max())))
+		{
+			fail("integer out of range");
+		}
+
+		return T(value);
+	}
+	else if constexpr (std::is_floating_point_v<T>)
+	{
+		return T(read_number());
+	}
+	else if constexpr (std::is_same_v<T, std::string>)
+	{
+		std::string out;
+		read_string(&out);
+		return out;
+	}
+	else if constexpr (std::is_same_v<T, godot::String>)
+	{
+		read_string(&string_);
+		return godot::String(string_.c_str());
+	}
+	else if constexpr (std::is_same_v<T, godot::Color>)
+	{
+		godot::Color out;
+		auto i { 0 };
+
+		visit_array([&]
+		{
+			if (i >= 4) fail("too many components for a Color");
+
+			const auto value { float(read_number()) };
+
+			switch (i++)
+			{
+				case 0: out.r = value; break;
+				case 1: out.g = value; break;
+				case 2: out.b = value; break;
+				default: out.a = value; break;
+			}
+		});
+
+		if (i != 4) fail("too few components for a Color");
+
+		return out;
+	}
+	else if constexpr (std::is_same_v<T, godot::Transform2D>)
+	{
+		godot::Transform2D out { godot::Transform2D::IDENTITY };
+		auto i { 0 };
+
+		visit_array([&]
+		{
+			if (i >= 6) fail("too many components for a Transform2D");
+
+			out[i / 2][i % 2] = float(read_number());
+			i++;
+		});
+
+		if (i != 6) fail("too few components for a Transform2D");
+
+		return out;
+	}
+	else if constexpr (std::is_same_v<T, godot::Variant>)
+	{
+		return read_variant();
+	}
+	else if constexpr (std::is_same_v<T, godot::Array> || std::is_same_v<T, godot::Dictionary>)
+	{
+		const auto type { peek() };
+
+		if (type != (std::is_same_v<T, godot::Array> ? Type::array : Type::object))
+		{
+			fail(std::is_same_v<T, godot::Array> ? "expected an array" : "expected an object");
+		}
+
+		return read_variant();
+	}
+	else
+	{
+		static_assert (!sizeof(T), "Unsupported type for json::Reader::read");
+	}
+}
+
+template <typename Visitor>
+auto Reader::visit_object(Visitor visitor) -> void
+{
+	skip_whitespace();
+	expect('{');
+	enter();
+
+	if (int(keys_.size()) < depth_) keys_.resize(depth_);
+
+	if (skip_whitespace() == '}')
+	{
+		get_char();
+		leave();
+		return;
+	}
+
+	for (;;)
+	{
+		auto& key { keys_[depth_ - 1] };
+
+		skip_whitespace();
+		read_string(&key);
+		skip_whitespace();
+		expect(':');
+
+		const auto values_before { values_ };
+
+		visitor(std::string_view{key});
+
+		if (!next_item('}', values_before)) break;
+	}
+
+	leave();
+}
+
+template <typename Visitor>
+auto Reader::visit_array(Visitor visitor) -> void
+{
+	skip_whitespace();
+	expect('[');
+	enter();
+
+	if (skip_whitespace() == ']')
+	{
+		get_char();
+		leave();
+		return;
+	}
+
+	for (;;)
+	{
+		const auto values_before { values_ };
+
+		visitor();
+
+		if (!next_item(']', values_before)) break;
+	}
+
+	leave();
+}
+
+template <typename T, typename Visitor>
+auto Reader::visit_array(Visitor visitor) -> void
+{
+	visit_array([this, &visitor] { visitor(read<T>()); });
+}
+
+template <typename KeyType, typename ValueType, typename Visitor>
+auto Reader::visit_dictionary_items(Visitor visitor) -> void
+{
+	visit_object([this, &visitor](std::string_view key)
+	{
+		if constexpr (std::is_same_v<KeyType, godot::String>)
+		{
+			visitor(godot::String(std::string{key}.c_str()), read<ValueType>());
+		}
+		else if constexpr (std::is_same_v<KeyType, std::string>)
+		{
+			visitor(std::string{key}, read<ValueType>());
+		}
+		else
+		{
+			KeyType out;
+
+			const auto [end, error] { std::from_chars(key.data(), key.data() + key.size(), out) };
+
+			if (error != std::errc{} || end != key.data() + key.size()) fail("invalid key");
+
+			visitor(out, read<ValueType>());
+		}
+	});
+}
+
+inline auto Reader::skip() -> void
+{
+	switch (peek())
+	{
+		case Type::null: read_null(); return;
+		case Type::boolean: read_bool(); return;
+		case Type::number: read_number_token(); return;
+		case Type::string: read_string(&string_); return;
+		case Type::array: visit_array([this] { skip(); }); return;
+		case Type::object: visit_object([this](std::string_view) { skip(); }); return;
+		case Type::end: fail("unexpected end of document");
+	}
+}
+
+inline auto Reader::fail(const char* message) const -> void
+{
+	throw std::runtime_error("JSON error at line " + std::to_string(line_) + ": " + message);
+}
+
+inline auto Reader::fill() -> bool
+{
+	if (!file_.is_open() || !file_) return false;
+
+	file_.read(chunk_.data(), std::streamsize(chunk_.size()));
+
+	size_ = size_t(file_.gcount());
+	pos_ = 0;
+
+	return size_ > 0;
+}
+
+inline auto Reader::peek_char() -> int
+{
+	if (pos_ == size_ && !fill()) return END;
+
+	return uint8_t(data_[pos_]);
+}
+
+inline auto Reader::get_char() -> int
+{
+	const auto c { peek_char() };
+
+	if (c != END) pos_++;
+	if (c == '\n') line_++;
+
+	return c;
+}
+
+inline auto Reader::skip_whitespace() -> int
+{
+	for (;;)
+	{
+		const auto c { peek_char() };
+
+		if (c != ' ' && c != '\t' && c != '\n' && c != '\r') return c;
+
+		get_char();
+	}
+}
+
+inline auto Reader::expect(char c) -> void
+{
+	if (get_char() != c)
+	{
+		const char message[] { 'e', 'x', 'p', 'e', 'c', 't', 'e', 'd', ' ', '\'', c, '\'', 0 };
+
+		fail(message);
+	}
+}
+
+inline auto Reader::expect_word(const char* word) -> void
+{
+	for (; *word; word++)
+	{
+		if (get_char() != *word) fail("invalid literal");
+	}
+}
+
+inline auto Reader::next_item(char close, uint64_t values_before) -> bool
+{
+	if (values_ == values_before)
+	{
+		skip();
+	}
+
+	const auto c { skip_whitespace() };
+
+	get_char();
+
+	if (c == close) return false;
+	if (c != ',') fail("expected ',' or a closing bracket");
+
+	return true;
+}
+
+inline auto Reader::read_null() -> void
+{
+	expect_word("null");
+	values_++;
+}
+
+inline auto Reader::read_bool() -> bool
+{
+	values_++;
+
+	if (skip_whitespace() == 't')
+	{
+		expect_word("true");
+		return true;
+	}
+
+	expect_word("false");
+	return false;
+}
+
+inline auto Reader::read_number() -> double
+{
+	const auto token { read_number_token() };
+
+	double out;
+
+	const auto [end, error] { std::from_chars(token.data(), token.data() + token.size(), out) };
+
+	if (error != std::errc{} || end != token.data() + token.size()) fail("invalid number");
+
+	return out;
+}
+
+// Accepts integral floats too ("3.0", "1e3"), which other writers produce
+inline auto Reader::read_integer() -> int64_t
+{
+	const auto token { read_number_token() };
+
+	int64_t out;
+
+	const auto [end, error] { std::from_chars(token.data(), token.data() + token.size(), out) };
+
+	if (error == std::errc{} && end == token.data() + token.size()) return out;
+
+	double real;
+
+	const auto [real_end, real_error] { std::from_chars(token.data(), token.data() + token.size(), real) };
+
+	if (real_error != std::errc{} || real_end != token.data() + token.size() || real != double(int64_t(real)))
+	{
+		fail("expected an integer");
+	}
+
+	return int64_t(real);
+}
+
+inline auto Reader::read_number_token() -> std::string_view
+{
+	if (peek() != Type::number) fail("expected a number");
+
+	number_.clear();
+	values_++;
+
+	for (;;)
+	{
+		const auto c { peek_char() };
+
+		if ((c < '0' || c > '9') && c != '-' && c != '+' && c != '.' && c != 'e' && c != 'E') break;
+
+		number_.push_back(char(get_char()));
+	}
+
+	return number_;
+}
+
+inline auto Reader::read_string(std::string* out) -> void
+{
+	if (skip_whitespace() != '"') fail("expected a string");
+
+	get_char();
+	out->clear();
+	values_++;
+
+	for (;;)
+	{
+		// Copy runs of plain characters straight out of the buffer
+		const auto start { pos_ };
+
+		while (pos_ < size_ && data_[pos_] != '"' && data_[pos_] != '\\' && data_[pos_] != '\n' && uint8_t(data_[pos_]) >= 0x20)
+		{
+			pos_++;
+		}
+
+		out->append(data_ + start, pos_ - start);
+
+		const auto c { get_char() };
+
+		switch (c)
+		{
+			case '"': return;
+			case END: fail("unterminated string");
+			case '\\': break;
+			default:
+			{
+				// A control character, or the run hit the end of a chunk
+				if (c < 0x20) fail("control character in string");
+
+				out->push_back(char(c));
+				continue;
+			}
+		}
+
+		switch (get_char())
+		{
+			case '"': out->push_back('"'); break;
+			case '\\': out->push_back('\\'); break;
+			case '/': out->push_back('/'); break;
+			case 'b': out->push_back('\b'); break;
+			case 'f': out->push_back('\f'); break;
+			case 'n': out->push_back('\n'); break;
+			case 'r': out->push_back('\r'); break;
+			case 't': out->push_back('\t'); break;
+			case 'u':
+			{
+				auto code { read_hex4() };
+
+				if (code >= 0xD800 && code < 0xDC00)
+				{
+					expect('\\');
+					expect('u');
+
+					const auto low { read_hex4() };
+
+					if (low < 0xDC00 || low >= 0xE000) fail("invalid surrogate pair");
+
+					code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+				}
+
+				if (code < 0x80)
+				{
+					out->push_back(char(code));
+				}
+				else if (code < 0x800)
+				{
+					out->push_back(char(0xC0 | (code >> 6)));
+					out->push_back(char(0x80 | (code & 0x3F)));
+				}
+				else if (code < 0x10000)
+				{
+					out->push_back(char(0xE0 | (code >> 12)));
+					out->push_back(char(0x80 | ((code >> 6) & 0x3F)));
+					out->push_back(char(0x80 | (code & 0x3F)));
+				}
+				else
+				{
+					out->push_back(char(0xF0 | (code >> 18)));
+					out->push_back(char(0x80 | ((code >> 12) & 0x3F)));
+					out->push_back(char(0x80 | ((code >> 6) & 0x3F)));
+					out->push_back(char(0x80 | (code & 0x3F)));
+				}
+
+				break;
+			}
+			default: fail("invalid escape");
+		}
+	}
+}
+
+inline auto Reader::read_hex4() -> uint32_t
+{
+	uint32_t out {};
+
+	for (int i = 0; i < 4; i++)
+	{
+		const auto c { get_char() };
+
+		out <<= 4;
+
+		if (c >= '0' && c <= '9') out |= uint32_t(c - '0');
+		else if (c >= 'a' && c <= 'f') out |= uint32_t(c - 'a' + 10);
+		else if (c >= 'A' && c <= 'F') out |= uint32_t(c - 'A' + 10);
+		else fail("invalid unicode escape");
+	}
+
+	return out;
+}
+
+inline auto Reader::read_variant() -> godot::Variant
+{
+	switch (peek())
+	{
+		case Type::null: read_null(); return {};
+		case Type::boolean: return read_bool();
+		case Type::number: return read_number();
+		case Type::string: return read<godot::String>();
+		case Type::array:
+		{
+			godot::Array out;
+			visit_array([this, &out] { out.append(read_variant()); });
+			return out;
+		}
+		case Type::object:
+		{
+			godot::Dictionary out;
+			visit_object([this, &out](std::string_view key) { out[godot::String(std::string{key}.c_str())] = read_variant(); });
+			return out;
+		}
+		case Type::end: fail("unexpected end of document");
+	}
+
+	return {};
+}
+
+inline auto Reader::enter() -> void
+{
+	if (++depth_ > MAX_DEPTH) fail("document nested too deeply");
+}
+
+inline auto Reader::leave() -> void
+{
+	depth_--;
+	values_++;
+}
+
+} // json
+} // gdn
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cassert>
+#include <optional>
+#include <utility>
+#include <Variant.hpp>
+
+namespace gdn {
+
+// A value that is decoded from its encoded form the first time it's read,
+// then kept. As a StructCodec field,
+//
+//   struct Project
+//   {
+//     godot::String name;
+//     gdn::Lazy<std::vector<Track>> tracks;
+//     gdn::Lazy<std::vector<Marker>> markers;
+//     ...
+//   };
+//
+// decoding a Project only decodes name; the tracks are decoded when
+// something first calls project.tracks.get(), and the markers maybe never.
+// Until a Lazy is modified it keeps the Variant it came from, and encoding
+// hands that straight back, so parts of a document nobody looked at are
+// neither decoded nor re-encoded when it's saved.
+//
+// Outside a codec, construct one from the Variant and a decode function:
+//
+//   gdn::Lazy<Waveform> waveform { data["waveform"], &decode_waveform };
+//
+// Not thread safe: the first get() writes.
+template <typename T>
+class Lazy
+{
+public:
+
+	using Decode = T(*)(const godot::Variant&);
+
+	Lazy() = default;
+	Lazy(T value);
+	Lazy(godot::Variant data, Decode decode);
+
+	auto get() const -> const T&;
+	auto operator*() const -> const T&;
+	auto operator->() const -> const T*;
+
+	// Decodes if necessary and forgets the encoded form, since the value
+	// may be about to change
+	auto get_mutable() -> T&;
+	auto set(T value) -> void;
+
+	auto is_decoded() const -> bool;
+
+	// Whether get_variant() still holds the value's encoded form
+	auto has_variant() const -> bool;
+	auto get_variant() const -> const godot::Variant&;
+
+private:
+
+	mutable std::optional<T> value_;
+	godot::Variant data_;
+	Decode decode_{};
+};
+
+// +++ Lazy +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+template <typename T>
+Lazy<T>::Lazy(T value)
+	: value_{std::move(value)}
+{
+}
+
+template <typename T>
+Lazy<T>::Lazy(godot::Variant data, Decode decode)
+	: data_{std::move(data)}
+	, decode_{decode}
+{
+	assert (decode_);
+}
+
+template <typename T>
+auto Lazy<T>::get() const -> const T&
+{
+	if (!value_)
+	{
+		value_ = decode_ ? decode_(data_) : T{};
+	}
+
+	return *value_;
+}
+
+template <typename T>
+auto Lazy<T>::operator*() const -> const T&
+{
+	return get();
+}
+
+template <typename T>
+auto Lazy<T>::operator->() const -> const T*
+{
+	return &get();
+}
+
+template <typename T>
+auto Lazy<T>::get_mutable() -> T&
+{
+	get();
+
+	data_ = godot::Variant{};
+	decode_ = nullptr;
+
+	return *value_;
+}
+
+template <typename T>
+auto Lazy<T>::set(T value) -> void
+{
+	value_ = std::move(value);
+	data_ = godot::Variant{};
+	decode_ = nullptr;
+}
+
+template <typename T>
+auto Lazy<T>::is_decoded() const -> bool
+{
+	return bool(value_);
+}
+
+template <typename T>
+auto Lazy<T>::has_variant() const -> bool
+{
+	return decode_ != nullptr;
+}
+
+template <typename T>
+auto Lazy<T>::get_variant() const -> const godot::Variant&
+{
+	return data_;
+}
+
+} // gdn
@@ -0,0 +1,275 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "binary_codec.hpp"
+
+namespace gdn {
+
+struct ParallelDecodeOptions
+{
+	// Records per work item
+	size_t chunk_size{256};
+
+	// Worker threads, 0 for one per core
+	unsigned threads{0};
+};
+
+// Decodes the records of a large top-level array of a binary document on
+// a pool of worker threads, for loads that would otherwise run visit_array
+// serially on the main thread:
+//
+//   const gdn::binary::MappedFile file { path };
+//   const auto clips { gdn::binary::root(file.data(), file.size()).find("clips") };
+//
+//   gdn::parallel_visit_array(*clips,
+//     [](gdn::binary::Value record) { return decode_clip(record); },  // workers
+//     [&](Clip clip) { model.add(std::move(clip)); });                // this thread
+//
+// Workers are handed byte ranges of the already serialized document, so
+// this thread only hops over section sizes to find where records start and
+// never touches the Godot API. decode must stay off the Godot API too (use
+// as_c_string() rather than as_string(), and build plain C++ values).
+// Documents held as a godot::Array have to be converted by the caller,
+// e.g. with binary::encode(); doing it here would put a Godot call per
+// value back on this thread.
+//
+// Each worker calls its own copy of decode, so state inside the callable
+// isn't shared, but anything it captures by reference is read from every
+// worker at once and must be safe for that.
+//
+// visitor is called on this thread with each decoded record, in the
+// original order, as soon as the chunk holding it is ready. An exception
+// thrown by decode is rethrown here when its record's turn comes; the
+// remaining workers are stopped.
+
+namespace detail {
+
+template <typename T, typename Decode>
+class DecodePipeline
+{
+public:
+
+	DecodePipeline(size_t count, const Decode& decode, ParallelDecodeOptions options);
+	DecodePipeline(const DecodePipeline&) = delete;
+	auto operator=(const DecodePipeline&) -> DecodePipeline& = delete;
+	~DecodePipeline();
+
+	auto get_chunk_count() const -> size_t;
+	auto get_chunk_size() const -> size_t;
+
+	// Hands a chunk's records to the workers. Chunks must be published in order
+	auto publish(std::vector<binary::Value> items) -> void;
+
+	template <typename Visitor>
+	auto consume(Visitor visitor) -> void;
+
+private:
+
+	struct Chunk
+	{
+		std::vector<binary::Value> items;
+		std::vector<T> results;
+		std::exception_ptr error;
+		bool done{false};
+	};
+
+	auto run(Decode decode) -> void;
+
+	size_t chunk_size_;
+	std::vector<Chunk> chunks_;
+	std::mutex mutex_;
+	std::condition_variable work_;
+	std::condition_variable done_;
+	size_t published_{0};
+	size_t claimed_{0};
+	bool stop_{false};
+	std::vector<std::thread> threads_;
+};
+
+template <typename T, typename Decode>
+DecodePipeline<T, Decode>::DecodePipeline(size_t count, const Decode& decode, ParallelDecodeOptions options)
+	: chunk_size_{std::max(options.chunk_size, size_t(1))}
+	, chunks_((count + chunk_size_ - 1) / chunk_size_)
+{
+	const auto threads { options.threads > 0 ? options.threads : std::max(std::thread::hardware_concurrency(), 1u) };
+	const auto workers { std::min(size_t(threads), chunks_.size()) };
+
+	for (size_t i = 0; i < workers; i++)
+	{
+		threads_.emplace_back([this, decode] { run(decode); });
+	}
+}
+
+template <typename T, typename Decode>
+DecodePipeline<T, Decode>::~DecodePipeline()
+{
+	{
+		std::lock_guard lock{mutex_};
+		stop_ = true;
+	}
+
+	work_.notify_all();
+
+	for (auto& thread : threads_)
+	{
+		thread.join();
+	}
+}
+
+template <typename T, typename Decode>
+auto DecodePipeline<T, Decode>::get_chunk_count() const -> size_t
+{
+	return chunks_.size();
+}
+
+template <typename T, typename Decode>
+auto DecodePipeline<T, Decode>::get_chunk_size() const -> size_t
+{
+	return chunk_size_;
+}
+
+template <typename T, typename Decode>
+auto DecodePipeline<T, Decode>::publish(std::vector<binary::Value> items) -> void
+{
+	{
+		std::lock_guard lock{mutex_};
+
+		chunks_[published_++].items = std::move(items);
+	}
+
+	work_.notify_one();
+}
+
+template <typename T, typename Decode>
+template <typename Visitor>
+auto DecodePipeline<T, Decode>::consume(Visitor visitor) -> void
+{
+	for (auto& chunk : chunks_)
+	{
+		{
+			std::unique_lock lock{mutex_};
+			done_.wait(lock, [&chunk] { return chunk.done; });
+		}
+
+		if (chunk.error)
+		{
+			std::rethrow_exception(chunk.error);
+		}
+
+		for (auto& result : chunk.results)
+		{
+			visitor(std::move(result));
+		}
+
+		chunk = {};
+	}
+}
+
+template <typename T, typename Decode>
+auto DecodePipeline<T, Decode>::run(Decode decode) -> void
+{
+	for (;;)
+	{
+		Chunk* chunk;
+
+		{
+			std::unique_lock lock{mutex_};
+
+			work_.wait(lock, [this] { return stop_ || claimed_ < published_; });
+
+			if (stop_) return;
+
+			chunk = &chunks_[claimed_++];
+		}
+
+		try
+		{
+			chunk->results.reserve(chunk->items.size());
+
+			for (const auto& item : chunk->items)
+			{
+				chunk->results.push_back(decode(item));
+			}
+		}
+		catch (...)
+		{
+			chunk->error = std::current_exception();
+		}
+
+		// Once done is set the chunk belongs to the consumer again
+		const auto failed { bool(chunk->error) };
+
+		{
+			std::lock_guard lock{mutex_};
+
+			chunk->done = true;
+
+			if (failed) stop_ = true;
+		}
+
+		done_.notify_all();
+
+		if (failed)
+		{
+			work_.notify_all();
+			return;
+		}
+	}
+}
+
+template <typename Decode>
+using decoded_t = std::decay_t<std::invoke_result_t<Decode&, binary::Value>>;
+
+} // detail
+
+template <typename Decode, typename Visitor>
+auto parallel_visit_array(binary::Value array, Decode decode, Visitor visitor, ParallelDecodeOptions options = {}) -> void
+{
+	static_assert (std::is_copy_constructible_v<Decode>, "Each worker gets its own copy of decode");
+
+	detail::DecodePipeline<detail::decoded_t<Decode>, Decode> pipeline { size_t(array.size()), decode, options };
+
+	// Finding where each record starts is just hopping over section sizes,
+	// so every chunk is published up front
+	std::vector<binary::Value> items;
+
+	array.visit_array([&](binary::Value item)
+	{
+		items.push_back(item);
+
+		if (items.size() == pipeline.get_chunk_size())
+		{
+			pipeline.publish(std::move(items));
+			items = {};
+		}
+	});
+
+	if (!items.empty())
+	{
+		pipeline.publish(std::move(items));
+	}
+
+	pipeline.consume(visitor);
+}
+
+// Same, collecting the decoded records in order
+template <typename Decode>
+auto parallel_decode(binary::Value array, Decode decode, ParallelDecodeOptions options = {}) -> std::vector<detail::decoded_t<Decode>>
+{
+	std::vector<detail::decoded_t<Decode>> out;
+
+	out.reserve(array.size());
+
+	parallel_visit_array(array, std::move(decode), [&out](auto&& record) { out.push_back(std::move(record)); }, options);
+
+	return out;
+}
+
+} // gdn
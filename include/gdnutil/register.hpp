@@ -2,6 +2,7 @@
 
 #include <Godot.hpp>
 
+#include "input_handler.hpp"
 #include "process_when_visible.hpp"
 
 namespace gdn {
@@ -11,4 +12,11 @@ static void register_classes()
 	godot::register_class<ProcessWhenVisible>();
 }
 
+// Frees state shared between instances. Call it from
+// godot_gdnative_terminate, before godot::Godot::gdnative_terminate()
+static void terminate()
+{
+	InputHandler::release();
+}
+
 } // gdn
\ No newline at end of file
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#pragma warning(push, 0)
+#include <GlobalConstants.hpp>
+#pragma warning(pop)
+
+#include "inline_function.hpp"
+#include "input_helpers.hpp"
+
+namespace gdn {
+
+struct KeyCombo
+{
+	int64_t scancode;
+
+	// EventInfo::Modifier bits. command is ignored since it's an alias for
+	// control or meta depending on the platform
+	uint8_t modifiers{0};
+};
+
+// All of a view's keyboard shortcuts, single keys and chords alike,
+// compiled into a trie keyed by key and modifiers:
+//
+//   shortcuts.add("undo", {{ KEY_Z, EventInfo::control }}, [this] { undo(); });
+//   shortcuts.add("save all", {{ KEY_K, EventInfo::control }, { KEY_S, EventInfo::control }}, [this] { save_all(); });
+//
+//   config.key.on_event = [this](const Ref<InputEventKey>& key)
+//   {
+//     if (shortcuts.handle(key)) return;
+//     ...
+//   };
+//
+// Each key press is one hash lookup from the current trie node. A press
+// that completes a sequence runs its callback; one that starts or
+// continues a chord is consumed and waits for the next. A press that
+// doesn't continue the pending chord abandons it and is matched from the
+// start. Pressing modifier keys on their own and key repeats never change
+// the state; while a chord is pending they're reported as handled, so
+// that holding control between the keys of a chord, or a repeating first
+// key, isn't passed on to other handlers halfway through the chord.
+//
+// add() throws if the new sequence is already bound, or if it and an
+// existing binding are prefixes of one another, since one of the two
+// could then never fire.
+class ShortcutMap
+{
+public:
+
+	using Callback = InlineFunction<void()>;
+
+	ShortcutMap();
+
+	auto add(std::string name, const std::vector<KeyCombo>& sequence, Callback callback) -> void;
+
+	// Whether the event was a key press that a binding used
+	auto handle(const EventInfo& info) -> bool;
+	auto handle(const godot::Ref<godot::InputEvent>& event) -> bool;
+
+	// Abandons a half-entered chord
+	auto cancel() -> void;
+	auto is_pending() const -> bool;
+
+private:
+
+	static constexpr uint32_t ROOT { 0 };
+
+	struct Node
+	{
+		std::unordered_map<uint64_t, uint32_t> children;
+		std::optional<uint32_t> binding;
+	};
+
+	struct Binding
+	{
+		std::string name;
+		Callback callback;
+	};
+
+	static auto make_key(int64_t scancode, uint8_t modifiers) -> uint64_t;
+	static auto is_modifier_key(int64_t scancode) -> bool;
+
+	auto find_child(uint32_t node, uint64_t key) const -> std::optional<uint32_t>;
+	auto find_binding_below(uint32_t node) const -> const Binding&;
+
+	std::vector<Node> nodes_;
+
+	// A deque so that a callback adding bindings doesn't move the one
+	// being called
+	std::deque<Binding> bindings_;
+	uint32_t state_{ROOT};
+};
+
+// +++ ShortcutMap ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+inline ShortcutMap::ShortcutMap()
+	: nodes_(1)
+{
+}
+
+inline auto ShortcutMap::add(std::string name, const std::vector<KeyCombo>& sequence, Callback callback) -> void
+{
+	if (sequence.empty())
+	{
+		throw std::runtime_error("Empty shortcut: " + name);
+	}
+
+	const auto conflict = [&name](const std::string& other)
+	{
+		throw std::runtime_error("Shortcut \"" + name + "\" conflicts with \"" + other + "\"");
+	};
+
+	// Check the whole path before adding anything, so a failed add leaves
+	// the map as it was
+	auto node { ROOT };
+	size_t matched { 0 };
+
+	for (; matched < sequence.size(); matched++)
+	{
+		const auto next { find_child(node, make_key(sequence[matched].scancode, sequence[matched].modifiers)) };
+
+		if (!next) break;
+
+		node = *next;
+
+		if (nodes_[node].binding) conflict(bindings_[*nodes_[node].binding].name);
+	}
+
+	if (matched == sequence.size())
+	{
+		conflict(find_binding_below(node).name);
+	}
+
+	for (; matched < sequence.size(); matched++)
+	{
+		const auto child { uint32_t(nodes_.size()) };
+
+		nodes_.emplace_back();
+		nodes_[node].children[make_key(sequence[matched].scancode, sequence[matched].modifiers)] = child;
+
+		node = child;
+	}
+
+	nodes_[node].binding = uint32_t(bindings_.size());
+
+	bindings_.push_back({ std::move(name), std::move(callback) });
+}
+
+inline auto ShortcutMap::handle(const EventInfo& info) -> bool
+{
+	if (info.kind != EventInfo::Kind::key || !info.pressed) return false;
+
+	// Swallowed mid-chord without abandoning it, see the class comment
+	if (info.echo || is_modifier_key(info.scancode)) return state_ != ROOT;
+
+	const auto key { make_key(info.scancode, info.modifiers) };
+
+	auto next { find_child(state_, key) };
+
+	if (!next && state_ != ROOT)
+	{
+		state_ = ROOT;
+		next = find_child(ROOT, key);
+	}
+
+	if (!next) return false;
+
+	const auto& node { nodes_[*next] };
+
+	if (!node.binding)
+	{
+		state_ = *next;
+		return true;
+	}
+
+	state_ = ROOT;
+
+	if (const auto& callback { bindings_[*node.binding].callback }) callback();
+
+	return true;
+}
+
+inline auto ShortcutMap::handle(const godot::Ref<godot::InputEvent>& event) -> bool
+{
+	return handle(classify(event));
+}
+
+inline auto ShortcutMap::cancel() -> void
+{
+	state_ = ROOT;
+}
+
+inline auto ShortcutMap::is_pending() const -> bool
+{
+	return state_ != ROOT;
+}
+
+inline auto ShortcutMap::make_key(int64_t scancode, uint8_t modifiers) -> uint64_t
+{
+	constexpr auto MASK { EventInfo::alt | EventInfo::shift | EventInfo::control | EventInfo::meta };
+
+	return (uint64_t(modifiers & MASK) << 32) | uint32_t(scancode);
+}
+
+inline auto ShortcutMap::is_modifier_key(int64_t scancode) -> bool
+{
+	switch (scancode)
+	{
+		case godot::GlobalConstants::KEY_SHIFT:
+		case godot::GlobalConstants::KEY_CONTROL:
+		case godot::GlobalConstants::KEY_ALT:
+		case godot::GlobalConstants::KEY_META:
+			return true;
+		default:
+			return false;
+	}
+}
+
+inline auto ShortcutMap::find_child(uint32_t node, uint64_t key) const -> std::optional<uint32_t>
+{
+	const auto& children { nodes_[node].children };
+	const auto pos { children.find(key) };
+
+	if (pos == children.end()) return std::nullopt;
+
+	return pos->second;
+}
+
+// Every node below the root leads to at least one binding
+inline auto ShortcutMap::find_binding_below(uint32_t node) const -> const Binding&
+{
+	while (!nodes_[node].binding)
+	{
+		node = nodes_[node].children.begin()->second;
+	}
+
+	return bindings_[*nodes_[node].binding];
+}
+
+} // gdn
@@ -0,0 +1,294 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "dictionary_helpers.hpp"
+#include "lazy.hpp"
+#include "string_helpers.hpp"
+
+namespace gdn {
+
+// Declares the Dictionary layout of a struct once, e.g.
+//
+//   struct Layer
+//   {
+//     godot::String name;
+//     godot::Color color;
+//     std::optional<float> opacity;
+//     std::vector<Shape> shapes;
+//
+//     static auto codec() -> const auto&
+//     {
+//       static const auto codec { gdn::make_codec(
+//         gdn::field("name", &Layer::name),
+//         gdn::field("color", &Layer::color),
+//         gdn::field("opacity", &Layer::opacity),
+//         gdn::field("shapes", &Layer::shapes)) };
+//
+//       return codec;
+//     }
+//   };
+//
+//   const auto data { Layer::codec().encode(layer) };
+//   const auto copy { Layer::codec().decode_json(data) };
+//
+// Keys are built once with the codec. Decoding walks the dictionary once
+// with for_each_item() instead of looking each field up; since the
+// encoder writes fields in declaration order, matching a key to its field
+// is normally a single comparison. Unknown keys are ignored, missing
+// std::optional fields are left empty and any other missing field throws.
+//
+// Field types are whatever dictionary_helpers.hpp handles, plus
+// std::optional<T>, std::vector<T>, gdn::Lazy<T> and nested structs with a
+// codec().
+// Vectors of int32s and floats are stored as pool arrays, which survive a
+// JSON round trip as plain arrays. Vectors of bytes and Colors are stored
+// as Arrays, since JSON.print writes their pool arrays as strings; all four
+// also decode from pool arrays in bulk.
+template <typename Struct, typename T>
+struct StructField
+{
+	const char* name;
+	T Struct::* member;
+};
+
+template <typename Struct, typename T>
+auto field(const char* name, T Struct::* member) -> StructField<Struct, T>
+{
+	return { name, member };
+}
+
+template <typename T>
+concept has_codec = requires (const T& value) { T::codec().encode(value); };
+
+namespace detail {
+
+template <typename T> struct is_optional : std::false_type {};
+template <typename T> struct is_optional<std::optional<T>> : std::true_type {};
+template <typename T> struct is_vector : std::false_type {};
+template <typename T> struct is_vector<std::vector<T>> : std::true_type {};
+template <typename T> struct is_pool_vector : std::false_type {};
+template <pool_element T> struct is_pool_vector<std::vector<T>> : std::true_type {};
+template <typename T> struct is_lazy : std::false_type {};
+template <typename T> struct is_lazy<Lazy<T>> : std::true_type {};
+
+template <typename T>
+auto encode_field(const T& value) -> godot::Variant
+{
+	if constexpr (is_lazy<T>::value)
+	{
+		return value.has_variant() ? value.get_variant() : encode_field(value.get());
+	}
+	else if constexpr (has_codec<T>)
+	{
+		return T::codec().encode(value);
+	}
+	else if constexpr (is_vector<T>::value && !is_pool_vector<T>::value)
+	{
+		godot::Array out;
+
+		out.resize(int(value.size()));
+
+		for (size_t i = 0; i < value.size(); i++)
+		{
+			out[int(i)] = encode_field(value[i]);
+		}
+
+		return out;
+	}
+	else
+	{
+		return gdn::encode(value);
+	}
+}
+
+template <typename T, typename Getter>
+auto decode_field(const godot::Variant& value) -> T
+{
+	if constexpr (is_optional<T>::value)
+	{
+		return decode_field<typename T::value_type, Getter>(value);
+	}
+	else if constexpr (is_lazy<T>::value)
+	{
+		using U = std::decay_t<decltype(std::declval<T>().get())>;
+
+		return T{ value, &decode_field<U, Getter> };
+	}
+	else if constexpr (has_codec<T>)
+	{
+		return T::codec().template decode<Getter>(Getter{}.template get<godot::Dictionary>(value));
+	}
+	else if constexpr (is_pool_vector<T>::value)
+	{
+		return decode_vector<typename T::value_type>(value);
+	}
+	else if constexpr (is_vector<T>::value)
+	{
+		const auto array { Getter{}.template get<godot::Array>(value) };
+
+		T out;
+
+		out.reserve(array.size());
+
+		for (int i = 0; i < array.size(); i++)
+		{
+			out.push_back(decode_field<typename T::value_type, Getter>(array[i]));
+		}
+
+		return out;
+	}
+	else if constexpr (std::is_same_v<T, godot::Color> || std::is_same_v<T, godot::Transform2D>)
+	{
+		return gdn::decode<T>(Getter{}.template get<godot::Array>(value));
+	}
+	else
+	{
+		return Getter{}.template get<T>(value);
+	}
+}
+
+// Index of key in keys, or N. Starts looking at hint, which is where the
+// key is when the dictionary came from the matching encoder. Compares
+// Variants directly, so no String is built per key
+template <size_t N>
+auto find_key(const std::array<godot::Variant, N>& keys, const godot::Variant& key, size_t hint) -> size_t
+{
+	for (size_t n = 0; n < N; n++)
+	{
+		const auto index { (hint + n) % N };
+
+		if (keys[index] == key) return index;
+	}
+
+	return N;
+}
+
+} // detail
+
+template <typename Struct, typename ...Types>
+class StructCodec
+{
+public:
+
+	StructCodec(StructField<Struct, Types>... fields);
+
+	auto encode(const Struct& value) const -> godot::Dictionary;
+	auto decode(godot::Dictionary data) const -> Struct;
+	auto decode_json(godot::Dictionary data) const -> Struct;
+
+	template <typename Getter>
+	auto decode(godot::Dictionary data) const -> Struct;
+
+private:
+
+	static constexpr auto SIZE { sizeof...(Types) };
+
+	template <typename Getter, size_t ...I>
+	auto decode(godot::Dictionary data, Struct* out, std::index_sequence<I...>) const -> void;
+
+	std::tuple<StructField<Struct, Types>...> fields_;
+	std::array<godot::Variant, SIZE> variant_keys_;
+};
+
+template <typename Struct, typename ...Types>
+auto make_codec(StructField<Struct, Types>... fields) -> StructCodec<Struct, Types...>
+{
+	return { fields... };
+}
+
+template <typename Struct, typename ...Types>
+StructCodec<Struct, Types...>::StructCodec(StructField<Struct, Types>... fields)
+	: fields_{fields...}
+	, variant_keys_{godot::Variant(godot::String(fields.name))...}
+{
+}
+
+template <typename Struct, typename ...Types>
+auto StructCodec<Struct, Types...>::encode(const Struct& value) const -> godot::Dictionary
+{
+	godot::Dictionary out;
+
+	[&]<size_t ...I>(std::index_sequence<I...>)
+	{
+		const auto write = [&](const godot::Variant& key, const auto& field_value)
+		{
+			using T = std::decay_t<decltype(field_value)>;
+
+			if constexpr (detail::is_optional<T>::value)
+			{
+				if (field_value) out[key] = detail::encode_field(*field_value);
+			}
+			else
+			{
+				out[key] = detail::encode_field(field_value);
+			}
+		};
+
+		(write(variant_keys_[I], value.*(std::get<I>(fields_).member)), ...);
+	}(std::index_sequence_for<Types...>{});
+
+	return out;
+}
+
+template <typename Struct, typename ...Types>
+auto StructCodec<Struct, Types...>::decode(godot::Dictionary data) const -> Struct
+{
+	return decode<detail::getter>(data);
+}
+
+template <typename Struct, typename ...Types>
+auto StructCodec<Struct, Types...>::decode_json(godot::Dictionary data) const -> Struct
+{
+	return decode<detail::json_getter>(data);
+}
+
+template <typename Struct, typename ...Types>
+template <typename Getter>
+auto StructCodec<Struct, Types...>::decode(godot::Dictionary data) const -> Struct
+{
+	Struct out{};
+
+	decode<Getter>(data, &out, std::index_sequence_for<Types...>{});
+
+	return out;
+}
+
+template <typename Struct, typename ...Types>
+template <typename Getter, size_t ...I>
+auto StructCodec<Struct, Types...>::decode(godot::Dictionary data, Struct* out, std::index_sequence<I...>) const -> void
+{
+	std::array<bool, SIZE> found{};
+	size_t next{0};
+
+	for_each_item(data, [&](const godot::Variant& key, const godot::Variant& value)
+	{
+		if (key.get_type() != godot::Variant::STRING) return;
+
+		const auto index { detail::find_key(variant_keys_, key, next) };
+
+		if (index == SIZE) return;
+
+		((I == index ? void(out->*(std::get<I>(fields_).member) = detail::decode_field<Types, Getter>(value)) : void()), ...);
+
+		found[index] = true;
+		next = index + 1;
+	});
+
+	const auto check = [&](size_t index, bool optional)
+	{
+		if (!found[index] && !optional)
+		{
+			throw std::runtime_error("Missing field: " + to_std_string(variant_keys_[index]));
+		}
+	};
+
+	(check(I, detail::is_optional<Types>::value), ...);
+}
+
+} // gdn